@@ -1,15 +1,21 @@
 #include "bxr.h"
+#include "bxrschema.h"
 
 #include "utility/streamtools.h"
 #include "utility/stringtools.h"
+#include "utility/xmlreader.h"
+#include "utility/xmlwriter.h"
 
-#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <fstream>
 #include <numeric>
+#include <optional>
 #include <ranges>
+#include <unordered_map>
 
-#include <boost/range/adaptors.hpp>
-
-namespace adaptor = boost::adaptors;
+#include <boost/iostreams/device/mapped_file.hpp>
 
 namespace {
 constexpr auto bxr_label = "BXR0";
@@ -17,22 +23,6 @@ constexpr auto unicode_literal = "unicode";
 constexpr auto type_hack_literal = "type";
 constexpr auto type_sub_literal = "sub";
 
-template<class T>
-uint32_t getStringSize(std::vector<T> const& evaluated) {
-    return std::accumulate(evaluated.begin(), evaluated.end(), 0, [](const auto &a, const auto &b){
-        return a + (-1 == b.offset ? 0 :b.symbol.size() + 1);
-    });
-}
-
-template<class T>
-void setStringData(std::vector<T>& origin, std::vector<char>& output) {
-    for(auto& entry: origin) {
-        entry->offset = output.size();
-        std::ranges::copy(entry->symbol, std::back_insert_iterator(output));
-        output.push_back('\0');
-    }
-}
-
 struct SectionSizes {
     unsigned int tag_main_script;
     unsigned int tag_sub_script;
@@ -41,62 +31,60 @@ struct SectionSizes {
     unsigned int symbol;
 };
 
-enum class CandidateType
-{
-    undef,
-    main,
-    sub
-};
-
-struct Candidate;
-
-typedef std::shared_ptr<Candidate> CandidatePtr;
-
-struct Candidate {
-    std::string tag;
-    std::optional<std::string> value;
-    std::optional<std::u16string> unicode;
-    int next_ticks;
-    CandidateType type = CandidateType::main;
-    std::vector<CandidatePtr> main_children;
-    std::vector<CandidatePtr> sub_children;
-    std::vector<CandidatePtr> sub_virtual;
-};
+// Hands out tag indices in order of first appearance. Tags known to the
+// schema skip the string hashing.
+struct TagInterner {
+    imas::file::BXRSchema const *schema = nullptr;
+    std::vector<int32_t> known;   // index per schema tag, -1 until seen
+    std::unordered_map<std::string_view, int32_t> indices;
+    std::vector<std::string_view> names;
+
+    void use(imas::file::BXRSchema const *new_schema) {
+        schema = new_schema;
+        known.assign(schema ? schema->names.size() : 0, -1);
+    }
 
-template <CandidateType F>
-bool filterCandidateType(Candidate const& entry) {
-    return F == entry.type;
-}
+    int32_t intern(std::string_view name, int32_t rank) {
+        if (-1 != rank) {
+            auto &index = known[rank];
+            if (-1 == index) {
+                index = names.size();
+                names.push_back(name);
+            }
+            return index;
+        }
+        auto const [iter, inserted] = indices.try_emplace(name, names.size());
+        if (inserted) {
+            names.push_back(name);
+        }
+        return iter->second;
+    }
 
-//makes hierarchy based on range
-template <class R>
-std::vector<imas::file::BXR::MainScriptEntry*> makeChildrenHierarchy(R const& range, int cur_tick) {
-  std::vector<imas::file::BXR::MainScriptEntry*> res;
-  for(auto iter = range.begin();iter != range.end();) {
-    res.push_back(*iter);
-    auto const ticks = (*iter)->next_ticks - cur_tick;
-    if(ticks > 1) {
-      (*iter)->children = makeChildrenHierarchy(std::ranges::subrange(iter + 1, iter + ticks), cur_tick + 1);
+    int32_t intern(std::string_view name) {
+        return intern(name, schema ? schema->find(name) : -1);
     }
-    iter += ticks;
-    cur_tick += ticks;
-  }
-  return res;
 };
 
-bool tryTag(std::string const &tag, auto &taglist) {
-  return std::ranges::find(taglist, tag, [](auto const &entry) {
-           return entry.symbol;
-         }) == taglist.end();
+// A value of a main item: the property or one of the subitems. They are
+// written per item, sorted by tag name.
+struct VirtualEntry {
+    int32_t item;
+    std::string_view tag;
+    std::string_view value;
+    bool property;
+    int32_t rank = -1;       // index in the schema, sorts like the tag
+    int32_t sub_tag = -1;
 };
 
-void addTag(CandidatePtr const& source,
-                                      auto &taglist) {
-  if (tryTag(source->tag, taglist)) {
-    typename std::remove_reference<decltype(taglist)>::type::value_type entry;
-    entry.symbol = source->tag;
-    taglist.push_back(entry);
-  }
+// Element whose kind isn't decided yet. It becomes a subitem if it holds
+// text, or is empty and has no attributes; otherwise it is a main item.
+struct OpenElement {
+    std::string_view tag;
+    std::optional<std::string_view> value;   // property, the first attribute other than unicode
+    std::optional<std::string_view> unicode;
+    std::optional<std::string_view> text;
+    int32_t item = -1;                       // main item index once decided
+    bool skip = false;                       // children of a subitem are ignored
 };
 }
 
@@ -136,135 +124,64 @@ Result BXR::openFromStream(std::basic_istream<char> *stream)
     // BLOCK1
     // Then we read main script tag offset
     m_main_tags.resize( sizes.tag_main_script );
-    for(auto& entry: m_main_tags) {
-        entry.offset = imas::utility::readLong(stream);
-    }
+    imas::utility::readRange(stream, std::span(m_main_tags));
 
     // BLOCK2
     // And a subscript tag offset
     m_sub_tags.resize( sizes.tag_sub_script );
-    for(auto& entry: m_sub_tags) {
-        entry.offset = imas::utility::readLong(stream);
-    }
+    imas::utility::readRange(stream, std::span(m_sub_tags));
 
     // BLOCK3
     // We fill the mainscript entries with the integer data
     m_main_items.resize( sizes.main_script );
-    for(auto& entry: m_main_items)
-    {
-        entry.before           = imas::utility::readLong(stream);
-        entry.next             = imas::utility::readLong(stream);
-        entry.data_tag         = imas::utility::readLong(stream);
-        entry.offset         = imas::utility::readLong(stream);
-        entry.index_sub_item = imas::utility::readLong(stream);
-        entry.offset_unicode   = imas::utility::readLong(stream);
-        entry.next_ticks   = imas::utility::readLong(stream);
-    }
+    imas::utility::readRange(stream, std::span(m_main_items));
 
     // BLOCK4
     // Ditto with subscript
     m_sub_items.resize( sizes.sub_script );
-    for(auto& entry: m_sub_items)
-    {
-        entry.next         = imas::utility::readLong(stream);
-        entry.data_tag      = imas::utility::readLong(stream);
-        entry.offset = imas::utility::readLong(stream);
-    }
+    imas::utility::readRange(stream, std::span(m_sub_items));
 
     // BLOCK5
     // Then we read some sort of symbolic data
-    std::vector<char> symbol(sizes.symbol);
-    stream->read(symbol.data(), symbol.size());
+    m_symbols.resize(sizes.symbol);
+    stream->read(m_symbols.data(), m_symbols.size());
+    if(!*stream) {
+        return {false, "unexpected end of file"};
+    }
 
     //
     // 解釈
     //
-
-    // BLOCK1
-    // Then we fill symbol data for the tag and script sections
-    for(auto& entry : m_main_tags) {
-        entry.symbol.assign(&symbol.data()[ entry.offset ]);
+    // Strings stay in the symbol chunk, so it only needs a sanity check
+    auto const validSymbol = [this](int32_t offset) {
+        return offset >= 0 && size_t(offset) < m_symbols.size()
+               && std::memchr(m_symbols.data() + offset, '\0', m_symbols.size() - offset);
+    };
+    if(!std::ranges::all_of(m_main_tags, validSymbol) || !std::ranges::all_of(m_sub_tags, validSymbol)) {
+        return {false, "tag name is out of the symbol chunk"};
     }
-
-    // BLOCK2
-    for(auto& entry : m_sub_tags) {
-        entry.symbol.assign(&symbol.data()[ entry.offset ]);
-    }
-
-    // BLOCK3    
-    //Setting substrings
-    for(auto iter = m_main_items.begin();iter != m_main_items.end();++iter) {
-        if( -1 != iter->index_sub_item) {
-          auto sub_iter = m_sub_items.begin() + iter->index_sub_item;
-            while(sub_iter != m_sub_items.end()) {
-                iter->subscript_children.push_back(&*sub_iter);
-#ifdef BXR_DEBUG_LINKS
-                sub_iter->parent = &*iter;
-#endif
-                if(-1 == sub_iter->next) {
-                    break;
-                }
-                ++sub_iter;
-            }
+    for(int32_t index = 0; index < std::ssize(m_main_items); ++index) {
+        auto const& entry = m_main_items[index];
+        if(entry.data_tag < 0 || size_t(entry.data_tag) >= m_main_tags.size()
+           || (-1 != entry.offset && !validSymbol(entry.offset))
+           || (-1 != entry.offset_unicode && (entry.offset_unicode < 0 || size_t(entry.offset_unicode) >= m_symbols.size()))
+           || (-1 != entry.index_sub_item && (entry.index_sub_item < 0 || size_t(entry.index_sub_item) >= m_sub_items.size()))
+           || entry.next_ticks <= index || size_t(entry.next_ticks) > m_main_items.size()) {
+            return {false, "broken main item " + std::to_string(index)};
         }
     }
-
-    m_root = makeChildrenHierarchy(m_main_items | std::views::transform([](MainScriptEntry& entry){
-                              return &entry;
-                            }), 0);
-
-    // for(auto iter = m_main_items.begin();iter != m_main_items.end();++iter) {
-    //   m_root.push_back(&*iter);
-    //   auto const ticks = iter->next_ticks;
-    //   auto const children_range = std::ranges::subrange(iter + 1, iter + ticks) | std::views::transform([](MainScriptEntry& entry){
-    //     return &entry;
-    //   });
-    //   iter->children.assign(children_range.begin(), children_range.end());
-    //   iter += ticks;
-    // }
-    //next ticks is amount of children
-    //you can get it from xml by literally counting children
-    //I only need to "unwrap" all of the children into the list
-    //probably should make methods for setting next_ticks recursively or unwrapping children
-
-    for(auto& entry : m_main_items)
-    {
-        auto& tag_data = m_main_tags[ entry.data_tag ];
-#ifdef BXR_DEBUG_LINKS
-        tag_data.entries.push_back(&entry);
-#endif
-        entry.tag_view = tag_data.symbol;
-        if( -1 != entry.offset ) {
-            entry.symbol.assign(&symbol.data()[ entry.offset ]);
-        }
-
-        // 歌詞など
-        if( -1 != entry.offset_unicode )
-        {
-            entry.unicode.assign( (char16_t*) & symbol[ entry.offset_unicode ]);
-            //Curiously, symbol data has mixed 8 and 16 bit-wide strings
-            //So we need to convert the endianess for the 16 bit strings
-            for(auto& character: entry.unicode) {
-                character = std::byteswap(character);
-            }
+    // The property is the only sub tag no subitem refers to
+    std::vector<bool> used_sub_tags(m_sub_tags.size());
+    for(int32_t index = 0; index < std::ssize(m_sub_items); ++index) {
+        auto const& entry = m_sub_items[index];
+        if(entry.data_tag < 0 || size_t(entry.data_tag) >= m_sub_tags.size() || !validSymbol(entry.offset)) {
+            return {false, "broken sub item " + std::to_string(index)};
         }
+        used_sub_tags[entry.data_tag] = true;
     }
 
-    // BLOCK4
-    for(auto& entry: m_sub_items)
-    {
-        auto& tag_data = m_sub_tags[ entry.data_tag ];
-#ifdef BXR_DEBUG_LINKS
-        tag_data.entries.push_back(&entry);
-#endif
-        entry.tag_view = tag_data.symbol;
-        entry.symbol = std::string(&symbol.data()[ entry.offset ]);
-    }
-
-    if(auto const prop_i = std::ranges::find(m_sub_tags, 0, [](auto const& entry){
-        return entry.entries.size();
-    }); prop_i != m_sub_tags.end()) {
-      m_property_name = prop_i->symbol;
+    if(auto const prop_i = std::ranges::find(used_sub_tags, false); prop_i != used_sub_tags.end()) {
+      m_property_name = symbol(m_sub_tags[std::distance(used_sub_tags.begin(), prop_i)]);
     }else{
       return {false, "failed to find property name"};
     }
@@ -272,404 +189,335 @@ Result BXR::openFromStream(std::basic_istream<char> *stream)
     return {true, "succesfully loaded"};
 }
 
-void BXR::SubScriptEntry::setNode(pugi::xml_node &parent) const {
-  auto node = parent.append_child(pugi::xml_node_type::node_element);
-  node.set_name(tag_view.data());
-  auto text = node.append_child(pugi::xml_node_type::node_pcdata);
-  text.set_value(symbol.c_str());
+std::string_view BXR::symbol(int32_t offset) const {
+  return m_symbols.data() + offset;
 }
 
-void BXR::MainScriptEntry::setNode(pugi::xml_node &parent, std::string const& property_name) const {
-  auto node = parent.append_child(pugi::xml_node_type::node_element);
+void BXR::writeNode(utility::XmlWriter &writer, int32_t index, std::string &scratch) const {
+  auto const& entry = m_main_items[index];
+  writer.startElement(symbol(m_main_tags[entry.data_tag]));
 
-  node.set_name(tag_view.data());
-
-  if (-1 != offset) {
-    auto attr = node.append_attribute(property_name.c_str());
-    attr.set_value(symbol.c_str());
+  if (-1 != entry.offset) {
+    writer.attribute(m_property_name, symbol(entry.offset));
   }
 
-  if(-1 != offset_unicode) {
-    WidestringConv converter;
-    auto uni_attr = node.append_attribute(unicode_literal);
-    uni_attr.set_value(converter.to_bytes(unicode).c_str());
+  //Curiously, symbol data has mixed 8 and 16 bit-wide strings
+  //The 16 bit ones are big-endian
+  if(-1 != entry.offset_unicode) {
+    scratch.clear();
+    utility::appendUtf8FromUtf16BE(scratch, std::span(m_symbols).subspan(entry.offset_unicode));
+    writer.attribute(unicode_literal, scratch);
   }
 
-  for(auto const& sub_child: subscript_children) {
-    sub_child->setNode(node);
+  if(-1 != entry.index_sub_item) {
+    for(auto sub_index = entry.index_sub_item; sub_index < std::ssize(m_sub_items); ++sub_index) {
+      auto const& sub_child = m_sub_items[sub_index];
+      writer.textElement(symbol(m_sub_tags[sub_child.data_tag]), symbol(sub_child.offset));
+      if(-1 == sub_child.next) {
+        break;
+      }
+    }
   }
 
-  for(auto const& child: children) {
-    child->setNode(node, property_name);
+  for(auto child = index + 1; child < entry.next_ticks; child = m_main_items[child].next_ticks) {
+    writeNode(writer, child, scratch);
   }
+  writer.endElement();
 }
 
 Result BXR::extract(std::filesystem::path const &savepath) const
 {
-  pugi::xml_document doc;
-
-  for(auto const& root_elem: m_root) {
-    root_elem->setNode(doc, m_property_name);
+  std::ofstream stream(savepath, std::ios_base::binary);
+  if (!stream.is_open()) {
+    return {false, "failed to open " + savepath.string()};
+  }
+  exportXml(stream);
+  if (!stream) {
+    return {false, "failed to write " + savepath.string()};
   }
-
-  doc.save_file(savepath.string().c_str());
   return {true, ""};
 }
 
-template<pugi::xml_node_type T>
-bool checkNodeType(pugi::xml_node const& node) {
-  return node.type() == T;
+// Written straight from the tables, no DOM in between
+void BXR::exportXml(std::ostream &stream) const
+{
+  utility::XmlWriter writer(stream);
+  writer.declaration();
+  std::string scratch;
+  for(int32_t root = 0; root < std::ssize(m_main_items); root = m_main_items[root].next_ticks) {
+    writeNode(writer, root, scratch);
+  }
+  writer.finish();
 }
 
 Result BXR::inject(std::filesystem::path const &openpath) {
   reset();
-  pugi::xml_document doc;
-  doc.load_file(openpath.string().c_str());
-
-  std::vector<CandidatePtr> root_candidates;
-  std::vector<CandidatePtr> main_items;
-  std::vector<CandidatePtr> sub_items;
-
-  WidestringConv conventer;
-
-  std::function<void(CandidatePtr &, pugi::xml_node const &)> nodeWalker;
-  nodeWalker = [&nodeWalker, &conventer, &main_items, &sub_items,
-                this](CandidatePtr &parent, pugi::xml_node const &node) {
-    parent->tag = node.name();
-
-    for (auto const &attr : node.attributes()) {
-      if (0 == std::strcmp(unicode_literal, attr.name())) {
-        parent->unicode = conventer.from_bytes(attr.value());
-      } else {
-        if (m_property_name.empty()) {
-          m_property_name = attr.name();
-        }
-        parent->value = node.attributes_begin()->value();
-      }
+  boost::iostreams::mapped_file_source file;
+  try {
+    if (0 == std::filesystem::file_size(openpath)) {
+      return {false, openpath.string() + " is empty"};
     }
+    file.open(openpath.native());
+  } catch (std::exception const &e) {
+    return {false, "failed to open " + openpath.string() + ": " + e.what()};
+  }
+  auto const result = importXml({file.data(), file.size()});
+  if (!result.first) {
+    return {false, openpath.string() + ": " + result.second};
+  }
+  return result;
+}
 
-    //Detect empty subitems - <subtag></subtag>
-    if (!parent->unicode.has_value() && !parent->value.has_value() &&
-        node.children().empty()) {
-      parent->type = CandidateType::sub;
-      return;
-    }
-
-    // parent.main_children.reserve(std::ranges::distance(node |
-    // std::views::filter(checkNodeType<pugi::xml_node_type::node_element>)));
-    // parent.sub_children.reserve(std::ranges::distance(node |
-    // std::views::filter([](pugi::xml_node const& node){
-    //   return pugi::xml_node_type::node_pcdata ==
-    //   node.children().begin()->type();
-    // })));
-    for (auto const &n_child : node) {
-      if (n_child.type() == pugi::xml_node_type::node_pcdata) {
-        parent->type = CandidateType::sub;
-        parent->value = n_child.value();
-        break;
-      }
-      CandidatePtr c_child = std::make_shared<Candidate>();
-      nodeWalker(c_child, n_child);
-      switch (c_child->type) {
-      case CandidateType::main: {
-        parent->main_children.push_back(c_child);
-      } break;
-      case CandidateType::sub: {
-        parent->sub_children.push_back(c_child);
-      } break;
-      default:
-        break;
-      }
+// Entries are built as elements arrive, nothing but the open elements and
+// the values waiting to be sorted is kept
+Result BXR::importXml(std::string_view document, BXRSchema const *schema) {
+  reset();
+  utility::XmlReader reader(document);
+
+  // Strings are views into the document, only unescaped ones need a copy
+  std::deque<std::string> unescaped;
+  auto const keep = [&document, &unescaped](std::string_view value) -> std::string_view {
+    if (value.data() >= document.data() && value.data() + value.size() <= document.data() + document.size()) {
+      return value;
     }
+    return unescaped.emplace_back(value);
   };
-  //root_candidates.reserve(std::ranges::distance(doc));
-  for (auto const &root_elem : doc) {
-    auto &candidate = root_candidates.emplace_back(std::make_shared<Candidate>());
-    main_items.push_back(candidate);
-    nodeWalker(candidate, root_elem);
-  }
-  std::function<int(CandidatePtr const&, int)> candidateUnwrapper;
-  candidateUnwrapper = [&candidateUnwrapper, &main_items, &sub_items, this](CandidatePtr const& candidate, int cur_tick) -> int {
-    int ticks = 1;
-    if(candidate->value.has_value()) {
-      candidate->sub_virtual.push_back(candidate);
-    }
-    for(auto const& sub: candidate->sub_children) {
-      sub_items.push_back(sub);
-      candidate->sub_virtual.push_back(sub);
-    }
-    //processing children
-    std::ranges::sort(candidate->sub_virtual, {}, [this](CandidatePtr const& elem){
-      return CandidateType::main == elem->type ? m_property_name : elem->tag;
-    });
-    for(auto const& ptr: candidate->sub_virtual) {
-      switch (ptr->type) {
-        case CandidateType::main:
-        if(tryTag(m_property_name, m_sub_tags)) {
-          auto &property_e = m_sub_tags.emplace_back();
-          property_e.symbol = m_property_name;
-        }
-          break;
-        case CandidateType::sub:
-        addTag(ptr, m_sub_tags);
-          break;
-        default:
-        break;
+
+  // Root tags head the tag list, the rest follow in depth-first order
+  TagInterner root_tags;
+  TagInterner inner_tags;
+  std::vector<VirtualEntry> virtual_entries;
+  std::vector<char> unicode_symbols;
+  std::unordered_map<std::string_view, int32_t> unicode_offsets;
+  std::vector<OpenElement> open_elements;
+  auto const rankOf = [&schema](std::string_view tag) {
+    return schema ? schema->find(tag) : -1;
+  };
+
+  auto const addMainItem = [&](OpenElement &element, bool root) {
+    int32_t const index = m_main_items.size();
+    auto &entry = m_main_items.emplace_back();
+    entry.before = index - 1;
+    entry.next = index + 1;
+    entry.data_tag = root ? root_tags.intern(element.tag) : -1 - inner_tags.intern(element.tag);
+    if (element.unicode) {
+      auto const [iter, inserted] = unicode_offsets.try_emplace(*element.unicode, unicode_symbols.size());
+      if (inserted) {
+        utility::appendUtf16BEFromUtf8(unicode_symbols, *element.unicode);
+        unicode_symbols.push_back('\0');
+        unicode_symbols.push_back('\0');
       }
+      entry.offset_unicode = iter->second;
     }
-    for(auto const& main: candidate->main_children) {
-      main_items.push_back(main);
-      ticks += candidateUnwrapper(main, cur_tick + ticks);
+    if (element.value) {
+      virtual_entries.push_back({index, m_property_name, *element.value, true, rankOf(m_property_name)});
     }
-    candidate->next_ticks = cur_tick + ticks;
-    return ticks;
+    element.item = index;
   };
-  int ticks = 0;
-  for(auto const& root_cand: root_candidates) {
-    ticks += candidateUnwrapper(root_cand, ticks);
-  }
-  //
-  m_main_items.reserve(main_items.size());
-  m_sub_items.reserve(sub_items.size());
-  // Collect tags
-  int32_t offset_counter = 0;
-  auto const enumerateTags = [&offset_counter](auto& taglist) {
-    for(auto &tag: taglist) {
-      tag.offset = offset_counter++;
-    }
-  };
-  for (auto const& item : main_items) {
-    addTag(item, m_main_tags);
-  }
-  // for (auto const& item : sub_items) {
-  //   addTag(item, m_sub_tags);
-  // }
-  enumerateTags(m_main_tags);
-  enumerateTags(m_sub_tags);
-  auto const match_tag = [](auto const &taglist, std::string const &tag,
-                            OffsetTaggable *entry) {
-    auto const res =
-        std::ranges::find(taglist, tag, &Offsetable::symbol);
-    entry->data_tag = std::distance(taglist.begin(), res);
-    entry->tag_view = res->symbol;
-  };
-  std::function<void(CandidatePtr const&)> entryUnwrapper;
-  auto const childUnwrapper = [&offset_counter, this, &match_tag](std::vector<CandidatePtr> const& range) {
-    auto &parent = m_main_items.back();
-    for(CandidatePtr const& c_ptr: range) {
-      switch (c_ptr->type) {
-        case CandidateType::main:
-        {
-          if (c_ptr->value.has_value()) {
-            parent.symbol = c_ptr->value.value(); //this should throw
-            parent.offset = offset_counter++;
-          }
+
+  for (auto event = reader.next(); utility::XmlReader::Event::end_document != event; event = reader.next()) {
+    switch (event) {
+    case utility::XmlReader::Event::start_element: {
+      bool skip = false;
+      if (!open_elements.empty()) {
+        auto &parent = open_elements.back();
+        // Text makes the parent a subitem, otherwise a child makes it a main item
+        skip = parent.skip || parent.text.has_value();
+        if (!skip && -1 == parent.item) {
+          addMainItem(parent, false);
         }
-        break;
-        case CandidateType::sub:
-        {
-          auto &entry = m_sub_items.emplace_back();
-          match_tag(m_sub_tags, c_ptr->tag, &entry);
-          entry.symbol = c_ptr->value.value_or(std::string{""});
-          entry.offset = offset_counter++;
-
-          // Being a sub means that the entry is a child of a previous main entry
-          if (parent.subscript_children.empty()) {
-            parent.index_sub_item = m_sub_items.size() - 1;
+      }
+      if (open_elements.empty() && m_main_items.empty()) {
+        if (!schema) {
+          schema = findSchema(reader.name());
+        }
+        root_tags.use(schema);
+        inner_tags.use(schema);
+      }
+      auto &element = open_elements.emplace_back();
+      element.tag = reader.name();
+      element.skip = skip;
+      for (auto const &attr : reader.attributes()) {
+        if (unicode_literal == attr.name) {
+          element.unicode = keep(attr.value);
+        } else if (!element.value) {
+          if (m_property_name.empty()) {
+            m_property_name = attr.name;
           }
-          parent.subscript_children.push_back(&entry);
+          element.value = keep(attr.value);
         }
-        break;
-        default:
+      }
+      if (1 == open_elements.size()) {
+        addMainItem(element, true);
+      }
+    } break;
+    case utility::XmlReader::Event::text: {
+      auto &element = open_elements.back();
+      if (!element.skip && -1 == element.item && !element.text) {
+        element.text = keep(reader.text());
+      }
+    } break;
+    case utility::XmlReader::Event::end_element: {
+      auto const element = open_elements.back();
+      open_elements.pop_back();
+      if (element.skip) {
         break;
       }
+      auto item = element.item;
+      if (-1 == item) {
+        if (element.text || (!element.value && !element.unicode)) {
+          virtual_entries.push_back({open_elements.back().item, element.tag, element.text.value_or(std::string_view{}), false, rankOf(element.tag)});
+          break;
+        }
+        auto leaf = element;
+        addMainItem(leaf, false);
+        item = leaf.item;
+      }
+      m_main_items[item].next_ticks = m_main_items.size();
+    } break;
+    case utility::XmlReader::Event::error:
+      return {false, "failed to parse: " + reader.error() + " (at byte " + std::to_string(reader.position()) + ")"};
+    default:
+      break;
     }
-  };
-  entryUnwrapper = [&offset_counter, &entryUnwrapper, this, &match_tag, &childUnwrapper](CandidatePtr const& c_ptr) {
-    auto &entry = m_main_items.emplace_back();
-    match_tag(m_main_tags, c_ptr->tag, &entry);
-
-    entry.next_ticks = c_ptr->next_ticks;
-    if (c_ptr->unicode.has_value()) {
-      entry.unicode = c_ptr->unicode.value();
-      entry.offset_unicode = 1;
+  }
+  if (m_main_items.empty()) {
+    return {false, "no elements found"};
+  }
+  m_main_items.back().next = -1;
+
+  // Inner tags that are also root tags keep the root index
+  std::vector<int32_t> inner_indices;
+  inner_indices.reserve(inner_tags.names.size());
+  auto main_tags = root_tags;
+  for (auto const tag : inner_tags.names) {
+    inner_indices.push_back(main_tags.intern(tag));
+  }
+  for (auto &entry : m_main_items) {
+    if (entry.data_tag < 0) {
+      entry.data_tag = inner_indices[-1 - entry.data_tag];
     }
+  }
 
-    // if(!m_main_items.empty()) {
-    //   auto &parent = m_main_items.back();
-    //   parent.children.push_back(&entry);
-    // }
+  // Values go item by item, sorted by tag; sub tags are numbered in that order.
+  // Schema ranks sort like the tags, so known pairs skip the string compare.
+  std::ranges::stable_sort(virtual_entries, [](VirtualEntry const &a, VirtualEntry const &b) {
+    if (a.item != b.item) {
+      return a.item < b.item;
+    }
+    if (-1 != a.rank && -1 != b.rank) {
+      return a.rank < b.rank;
+    }
+    return a.tag < b.tag;
+  });
+  TagInterner sub_tags;
+  sub_tags.use(schema);
+  size_t symbol_capacity = unicode_symbols.size() + 1;
+  for (auto &v_entry : virtual_entries) {
+    v_entry.sub_tag = sub_tags.intern(v_entry.tag, v_entry.rank);
+    symbol_capacity += v_entry.value.size() + 1;
+  }
+  for (auto const tag : main_tags.names) {
+    symbol_capacity += tag.size() + 1;
+  }
+  for (auto const tag : sub_tags.names) {
+    symbol_capacity += tag.size() + 1;
+  }
 
-    childUnwrapper(c_ptr->sub_virtual);
-    for(auto const& child: c_ptr->main_children) {
-      entryUnwrapper(child);
+  // Symbol chunk order: tag names, values entry by entry, unicode strings.
+  // Equal strings are stored once and share the offset.
+  m_symbols.reserve(symbol_capacity);
+  std::unordered_map<std::string_view, int32_t> symbol_offsets;
+  auto const addSymbol = [this, &symbol_offsets](std::string_view value) -> int32_t {
+    auto const [iter, inserted] = symbol_offsets.try_emplace(value, m_symbols.size());
+    if (inserted) {
+      m_symbols.insert(m_symbols.end(), value.begin(), value.end());
+      m_symbols.push_back('\0');
     }
+    return iter->second;
   };
-  for(auto& candidate: root_candidates) {
-    entryUnwrapper(candidate);
-  }
-  // Enumerate entries
-  {
-    int index = 0;
-    std::for_each(m_main_items.begin(), m_main_items.end(),
-                  [&index](MainScriptEntry &child) {
-                    child.before = index - 1;
-                    child.next = index + 1;
-                    ++index;
-                  });
-    m_main_items.back().next = -1;
-  }
-  // Build tag hierarchy
-  // {
-  //   auto iter = m_main_items.begin();
-  //   while (iter != m_main_items.end()) {
-  //     if (auto const next = iter + 1; next != m_main_items.end()) {
-  //       if (next->power < iter->power) {
-  //         iter->next_ticks = std::distance(m_main_items.begin(), next);
-  //         ++iter;
-  //         continue;
-  //       }
-  //     }
-  //     auto const closure = std::find_if(iter + 1, m_main_items.end(),
-  //                                       [&iter](MainScriptEntry &entry) {
-  //                                         return entry.power == iter->power;
-  //                                       });
-  //     iter->next_ticks = std::distance(m_main_items.begin(), closure);
-  //     ++iter;
-  //   }
-  // }
-  // Enumerate children
-  for (auto &item :
-       m_main_items | std::views::filter([](MainScriptEntry const &entry) {
-         return !entry.subscript_children.empty();
-       })) {
-    int index = item.index_sub_item;
-    std::for_each(item.subscript_children.begin(),
-                  item.subscript_children.end() - 1,
-                  [&index](SubScriptEntry *child) { child->next = ++index; });
-    item.subscript_children.back()->next = -1;
+  m_main_tags.reserve(main_tags.names.size());
+  for (auto const tag : main_tags.names) {
+    m_main_tags.push_back(addSymbol(tag));
+  }
+  m_sub_tags.reserve(sub_tags.names.size());
+  for (auto const tag : sub_tags.names) {
+    m_sub_tags.push_back(addSymbol(tag));
+  }
+  m_sub_items.reserve(virtual_entries.size());
+  for (auto const &v_entry : virtual_entries) {
+    auto &entry = m_main_items[v_entry.item];
+    if (v_entry.property) {
+      entry.offset = addSymbol(v_entry.value);
+      continue;
+    }
+    int32_t const sub_index = m_sub_items.size();
+    // Subitems of a main item are consecutive, the last one has no 'next'
+    if (-1 == entry.index_sub_item) {
+      entry.index_sub_item = sub_index;
+    } else {
+      m_sub_items.back().next = sub_index;
+    }
+    m_sub_items.push_back({.next = -1, .data_tag = v_entry.sub_tag, .offset = addSymbol(v_entry.value)});
+  }
+  // Even the chunk before the unicode part
+  if (m_symbols.size() % 2) {
+    m_symbols.push_back('\0');
+  }
+  int32_t const unicode_base = m_symbols.size();
+  m_symbols.insert(m_symbols.end(), unicode_symbols.begin(), unicode_symbols.end());
+  for (auto &entry : m_main_items) {
+    if (-1 != entry.offset_unicode) {
+      entry.offset_unicode += unicode_base;
+    }
   }
 
   return {true, "xml data injected"};
 }
 
-uint32_t BXR::getUnicodeSize() const {
-    return std::accumulate(
-        m_main_items.begin(), m_main_items.end(), 0,
-        [](const auto& a, const imas::file::BXR::MainScriptEntry& b) {
-          return a + (-1 == b.offset_unicode ? 0 : (b.unicode.size() + 1) * 2);
-        });
-}
-
-uint32_t BXR::calculateStringSize() const {
-    auto string_count = getStringSize(m_main_tags) + getStringSize(m_sub_tags)
-                        + getStringSize(m_main_items)
-                        + getStringSize(m_sub_items);
-    if (string_count % 2) {
-       ++string_count;
-    }
-    return string_count + getUnicodeSize();
-}
-
 size_t BXR::size() const {
-    uint32_t const string_size = calculateStringSize();
     uint32_t label = 4;                        // label
     uint32_t offsets = (5 * 4);                // offsets
     uint32_t tag_m = (4 * m_main_tags.size()); // Tag data (1 param = 8 bit)
     uint32_t tag_s = (4 * m_sub_tags.size());  //
     uint32_t main = (4 * 7 * m_main_items.size());
     uint32_t sub = (4 * 3 * m_sub_items.size());
-    return label + offsets + tag_m + tag_s + main + sub + string_size;
-}
-
-void BXR::setUnicodeData(std::vector<char>& output) {
-    for(auto& entry: m_main_items) {
-        if( -1 != entry.offset_unicode) {
-            entry.offset_unicode = output.size();
-            for (auto &sym : entry.unicode) {
-                output.push_back(static_cast<char>((sym >> 8) & 0xFF));
-                output.push_back(static_cast<char>(sym & 0xFF));
-            }
-            output.push_back('\0');
-            output.push_back('\0');
-        }
-    }
-}
-
-template<class T>
-void BXR::insertIntoQueue(std::vector<T>& origin, std::vector<imas::file::BXR::Offsetable*>& output) {
-    auto transformed_range = origin | adaptor::filtered([](T& value){
-                                 return -1 != value.offset;
-                             }) | adaptor::transformed([](T& value){
-                                   return &value;
-                               });
-    output.insert(output.end(), transformed_range.begin(), transformed_range.end());
+    return label + offsets + tag_m + tag_s + main + sub + m_symbols.size();
 }
 
 Result BXR::saveToStream(std::basic_ostream<char> *stream) {
-    // 1. Let's start building the string chunk
-    std::vector<Offsetable*> offset_queue;
-
-    insertIntoQueue(m_main_tags, offset_queue);
-    insertIntoQueue(m_sub_tags, offset_queue);
-    insertIntoQueue(m_main_items, offset_queue);
-    insertIntoQueue(m_sub_items, offset_queue);
-
-    std::ranges::sort(offset_queue, {}, &Offsetable::offset);
-
-    std::vector<char> string_library;
-    string_library.reserve(calculateStringSize());
-    setStringData(offset_queue, string_library);
-    // Even the stream before writing unicode part
-    if (string_library.size() % 2) {
-        string_library.push_back('\0');
-    }
-    setUnicodeData(string_library);
+    // Everything is laid out in one buffer of the final size and written at once
+    std::vector<char> output;
+    output.reserve(size());
 
     // Write label
-    std::string label{bxr_label};
-    stream->write(label.data(), label.size());
+    output.insert(output.end(), bxr_label, bxr_label + 4);
 
     // Write base offsets
-    imas::utility::writeLong(stream, m_main_tags.size());
-    imas::utility::writeLong(stream, m_sub_tags.size());
-    imas::utility::writeLong(stream, m_main_items.size());
-    imas::utility::writeLong(stream, m_sub_items.size());
-    imas::utility::writeLong(stream, string_library.size());
+    imas::utility::appendValue<int32_t>(output, m_main_tags.size());
+    imas::utility::appendValue<int32_t>(output, m_sub_tags.size());
+    imas::utility::appendValue<int32_t>(output, m_main_items.size());
+    imas::utility::appendValue<int32_t>(output, m_sub_items.size());
+    imas::utility::appendValue<int32_t>(output, m_symbols.size());
 
     // Write sections data
-    for (auto& entry : m_main_tags) {
-        imas::utility::writeLong(stream, entry.offset);
-    }
+    imas::utility::appendRange(output, std::span<int32_t const>(m_main_tags));
 
     // BLOCK2
     // And a subscript tag offset
-    for (auto& entry : m_sub_tags) {
-        imas::utility::writeLong(stream, entry.offset);
-    }
+    imas::utility::appendRange(output, std::span<int32_t const>(m_sub_tags));
 
     // BLOCK3
     // We fill the mainscript entries with the integer data
-    for (auto& entry : m_main_items) {
-        imas::utility::writeLong(stream, entry.before);
-        imas::utility::writeLong(stream, entry.next);
-        imas::utility::writeLong(stream, entry.data_tag);
-        imas::utility::writeLong(stream, entry.offset);
-        imas::utility::writeLong(stream, entry.index_sub_item);
-        imas::utility::writeLong(stream, entry.offset_unicode);
-        imas::utility::writeLong(stream, entry.next_ticks);
-    }
+    imas::utility::appendRange(output, std::span<MainRow const>(m_main_items));
 
     // BLOCK4
     // Ditto with subscript
-    for (auto& entry : m_sub_items) {
-        imas::utility::writeLong(stream, entry.next);
-        imas::utility::writeLong(stream, entry.data_tag);
-        imas::utility::writeLong(stream, entry.offset);
-    }
+    imas::utility::appendRange(output, std::span<SubRow const>(m_sub_items));
 
     //. Write string chunk
-    stream->write(string_library.data(), string_library.size());
+    output.insert(output.end(), m_symbols.begin(), m_symbols.end());
+    stream->write(output.data(), output.size());
     return {true, ""};
 }
 
@@ -678,8 +526,200 @@ void BXR::reset() {
     m_sub_tags.clear();
     m_main_items.clear();
     m_sub_items.clear();
-    m_root.clear();
+    m_symbols.clear();
     m_property_name.clear();
+    m_tag_offsets.clear();
+    m_tag_elements.clear();
+    m_parents.clear();
+    m_value_index.clear();
+}
+
+// Counting sort of the elements by tag; parents come from the depth-first
+// layout, an element's parent is the nearest open one
+void BXR::buildElementIndex() const {
+  if (!m_tag_offsets.empty()) {
+    return;
+  }
+  m_tag_offsets.assign(m_main_tags.size() + 1, 0);
+  for (auto const &item : m_main_items) {
+    ++m_tag_offsets[item.data_tag + 1];
+  }
+  std::partial_sum(m_tag_offsets.begin(), m_tag_offsets.end(), m_tag_offsets.begin());
+  m_tag_elements.resize(m_main_items.size());
+  m_parents.resize(m_main_items.size());
+  auto fill = m_tag_offsets;
+  std::vector<int32_t> open;
+  for (int32_t index = 0; index < std::ssize(m_main_items); ++index) {
+    m_tag_elements[fill[m_main_items[index].data_tag]++] = index;
+    while (!open.empty() && m_main_items[open.back()].next_ticks <= index) {
+      open.pop_back();
+    }
+    m_parents[index] = open.empty() ? -1 : open.back();
+    open.push_back(index);
+  }
+}
+
+std::vector<std::pair<std::string_view, int32_t>> const &BXR::valueIndex(int32_t field_key) const {
+  auto const [iter, inserted] = m_value_index.try_emplace(field_key);
+  auto &values = iter->second;
+  if (!inserted) {
+    return values;
+  }
+  for (int32_t index = 0; index < std::ssize(m_main_items); ++index) {
+    auto const &item = m_main_items[index];
+    if (-1 == field_key) {
+      if (-1 != item.offset) {
+        values.emplace_back(symbol(item.offset), index);
+      }
+      continue;
+    }
+    for (auto sub_index = item.index_sub_item; -1 != sub_index && sub_index < std::ssize(m_sub_items); ++sub_index) {
+      auto const &sub_item = m_sub_items[sub_index];
+      if (field_key == sub_item.data_tag) {
+        values.emplace_back(symbol(sub_item.offset), index);
+      }
+      if (-1 == sub_item.next) {
+        break;
+      }
+    }
+  }
+  std::ranges::sort(values);
+  return values;
+}
+
+// Sub tag id of a field, -1 for the property
+std::optional<int32_t> BXR::fieldKey(std::string_view name) const {
+  if (name == m_property_name) {
+    return -1;
+  }
+  auto const iter = std::ranges::find(m_sub_tags, name, [this](int32_t offset) { return symbol(offset); });
+  if (iter == m_sub_tags.end()) {
+    return std::nullopt;
+  }
+  return int32_t(std::distance(m_sub_tags.begin(), iter));
+}
+
+bool BXR::matchesPath(int32_t element, std::vector<std::string_view> const &path, bool anchored) const {
+  for (auto segment = path.rbegin(); segment != path.rend(); ++segment) {
+    if (-1 == element || tag(element) != *segment) {
+      return false;
+    }
+    element = m_parents[element];
+  }
+  return !anchored || -1 == element;
+}
+
+// Elements with the last tag of the path, in document order
+std::vector<int32_t> BXR::candidates(std::vector<std::string_view> const &path, bool anchored) const {
+  buildElementIndex();
+  auto const tag_iter = std::ranges::find(m_main_tags, path.back(), [this](int32_t offset) { return symbol(offset); });
+  if (tag_iter == m_main_tags.end()) {
+    return {};
+  }
+  auto const tag_id = std::distance(m_main_tags.begin(), tag_iter);
+  std::vector<int32_t> result;
+  for (auto i = m_tag_offsets[tag_id]; i < m_tag_offsets[tag_id + 1]; ++i) {
+    if (matchesPath(m_tag_elements[i], path, anchored)) {
+      result.push_back(m_tag_elements[i]);
+    }
+  }
+  return result;
+}
+
+namespace {
+std::vector<std::string_view> splitPath(std::string_view path) {
+  std::vector<std::string_view> segments;
+  for (auto const segment : std::views::split(path, '/')) {
+    if (!segment.empty()) {
+      segments.emplace_back(segment.begin(), segment.end());
+    }
+  }
+  return segments;
+}
+} // namespace
+
+std::vector<int32_t> BXR::find(std::string_view path) const {
+  auto const segments = splitPath(path);
+  if (segments.empty()) {
+    return {};
+  }
+  return candidates(segments, path.starts_with('/'));
+}
+
+std::vector<int32_t> BXR::find(std::string_view path, std::string_view field, std::string_view value) const {
+  auto const segments = splitPath(path);
+  auto const key = fieldKey(field);
+  if (segments.empty() || !key) {
+    return {};
+  }
+  buildElementIndex();
+  auto const &values = valueIndex(*key);
+  auto const [first, last] = std::ranges::equal_range(
+      values, value, {}, &std::pair<std::string_view, int32_t>::first);
+  std::vector<int32_t> result;
+  for (auto const &[_, element] : std::ranges::subrange(first, last)) {
+    if (matchesPath(element, segments, path.starts_with('/'))) {
+      result.push_back(element);
+    }
+  }
+  return result;
+}
+
+std::vector<std::string_view> BXR::tagNames() const {
+  std::vector<std::string_view> names;
+  for (auto const offset : m_main_tags) {
+    names.push_back(symbol(offset));
+  }
+  for (auto const offset : m_sub_tags) {
+    if (std::ranges::find(names, symbol(offset)) == names.end()) {
+      names.push_back(symbol(offset));
+    }
+  }
+  return names;
+}
+
+std::string_view BXR::tag(int32_t element) const {
+  return symbol(m_main_tags[m_main_items[element].data_tag]);
+}
+
+int32_t BXR::parent(int32_t element) const {
+  buildElementIndex();
+  return m_parents[element];
+}
+
+std::optional<std::string_view> BXR::field(int32_t element, std::string_view name) const {
+  for (auto const &[field_name, value] : fields(element)) {
+    if (field_name == name) {
+      return value;
+    }
+  }
+  return std::nullopt;
+}
+
+std::vector<std::pair<std::string_view, std::string_view>> BXR::fields(int32_t element) const {
+  auto const &item = m_main_items[element];
+  std::vector<std::pair<std::string_view, std::string_view>> result;
+  if (-1 != item.offset) {
+    result.emplace_back(m_property_name, symbol(item.offset));
+  }
+  for (auto sub_index = item.index_sub_item; -1 != sub_index && sub_index < std::ssize(m_sub_items); ++sub_index) {
+    auto const &sub_item = m_sub_items[sub_index];
+    result.emplace_back(symbol(m_sub_tags[sub_item.data_tag]), symbol(sub_item.offset));
+    if (-1 == sub_item.next) {
+      break;
+    }
+  }
+  return result;
+}
+
+std::optional<std::string> BXR::unicode(int32_t element) const {
+  auto const &item = m_main_items[element];
+  if (-1 == item.offset_unicode) {
+    return std::nullopt;
+  }
+  std::string result;
+  utility::appendUtf8FromUtf16BE(result, std::span(m_symbols).subspan(item.offset_unicode));
+  return result;
 }
 
 }
@@ -1,17 +1,14 @@
 #pragma once
 
-#include <iostream>
-#define BXR_DEBUG_LINKS
-
 #include "filetypes/manageable.h"
+#include <cstdint>
 #include <filesystem>
+#include <optional>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <string_view>
 #include <vector>
-#ifdef BXR_DEBUG_LINKS
-#include <optional>
-#endif
-
-#include <thirdparty/OpenXLSX/OpenXLSX/external/pugixml/pugixml.hpp>
 
 //*********.bxr
 //1. Label("BXR0")
@@ -42,8 +39,13 @@
 //"h|id|src|w" and string values would go in  "128|1|swg_pro_com_mod_tit_win|326" order.
 
 namespace imas {
+namespace utility {
+class XmlWriter;
+}
 namespace file {
 
+struct BXRSchema;
+
 class BXR : public Manageable
 {
 public:
@@ -51,112 +53,74 @@ public:
     virtual Result extract(const std::filesystem::path& savepath) const override;
     virtual Result inject(const std::filesystem::path& openpath) override;
     void reset();
-    // void testCompare(BXR const& another) const {
-    //   for(auto [left, right]: std::views::zip(m_main_items, another.m_main_items)) {
-    //     if(left != right) {
-    //       std::cout << "left.symbol: " << left.symbol << " right.symbol: " << right.symbol << std::endl;
-    //       std::cout << "left.before: " << left.before << " right.before: " << right.before << std::endl;
-    //       std::cout << "left.index_sub_item: " << left.index_sub_item << " right.index_sub_item: " << right.index_sub_item << std::endl;
-    //       std::cout << "left.next: " << left.next << " right.next: " << right.next << std::endl;
-    //       std::cout << "left.next_ticks: " << left.next_ticks << " right.next_ticks: " << right.next_ticks << std::endl;
-    //     }
-    //   }
-    //   for(auto [left, right]: std::views::zip(m_sub_items, another.m_sub_items)) {
-    //     if(left != right) {
-    //       std::cout << "left.symbol: " << left.symbol << " right.symbol: " << right.symbol << std::endl;
-    //       std::cout << "left.next: " << left.next << " right.next: " << right.next << std::endl;
-    //     }
-    //   }
-    // }
+    // In-memory counterparts of extract/inject. Without a schema, import
+    // picks one of the known schemas by the first root tag, if any.
+    void exportXml(std::ostream& stream) const;
+    Result importXml(std::string_view document, BXRSchema const* schema = nullptr);
+    // Every tag name in use, main tags first, for declaring a schema
+    std::vector<std::string_view> tagNames() const;
+
+    // Read-only queries over the loaded tables, no XML involved. Elements are
+    // main item indices in document order, strings are views into the symbol
+    // table. A path is a chain of tags ("a/b/c"), a leading '/' anchors it at
+    // the root. Fields are the property and the subitems of an element.
+    // Indices are built on first use, so queries must not run concurrently.
+    std::vector<int32_t> find(std::string_view path) const;
+    std::vector<int32_t> find(std::string_view path, std::string_view field, std::string_view value) const;
+    int32_t elementCount() const { return int32_t(m_main_items.size()); }
+    std::string_view tag(int32_t element) const;
+    int32_t parent(int32_t element) const;
+    std::optional<std::string_view> field(int32_t element, std::string_view name) const;
+    std::vector<std::pair<std::string_view, std::string_view>> fields(int32_t element) const;
+    std::optional<std::string> unicode(int32_t element) const;
   protected:
     virtual Result openFromStream(std::basic_istream<char> *stream) override;
     virtual Result saveToStream(std::basic_ostream<char> *stream) override;
     virtual size_t size() const override;
   private:
-    struct Offsetable {
-      //raw data
-      int32_t offset = -1;
-      //convenience data
-      std::string symbol;
+    // Rows mirror the on-disk tables. Strings are offsets into m_symbols.
+    // Main items are stored depth first, so the hierarchy needs no links:
+    // the children of an item are the items up to its 'next_ticks'.
+    struct MainRow {
+        int32_t before = -1;         //Previous element
+        int32_t next = -1;           //Next element
+        int32_t data_tag = -1;       //index of a tag in m_main_tags
+        int32_t offset = -1;         //value of the property
+        int32_t index_sub_item = -1; //Index of the first subitem element. Amount of child elements decided by the subitem's 'next' field
+        int32_t offset_unicode = -1; //Points to the unicode string
+        int32_t next_ticks = 0;      //Index of the element past the last descendant of this one
     };
-
-#ifdef BXR_DEBUG_LINKS
-    template<class T>
-    struct OffsetData : public Offsetable
-    {
-        std::vector<T *> entries;
+    struct SubRow {
+        int32_t next = -1;           //Next subitem of the same main item, -1 for the last one
+        int32_t data_tag = -1;       //index of a tag in m_sub_tags
+        int32_t offset = -1;
     };
-public:
-    struct MainScriptEntry;
-private:
-#endif
+    // Tables are read and written as whole blocks
+    static_assert(sizeof(MainRow) == 7 * 4 && sizeof(SubRow) == 3 * 4);
 
-    struct OffsetTaggable : Offsetable {
-        //raw data
-        int data_tag = -1;               //index of a tag in a related tag list
-        //convenience data
-        std::string_view tag_view;
-    };
-public:
-    struct SubScriptEntry : OffsetTaggable {
-        int next;
-#ifdef BXR_DEBUG_LINKS
-        std::optional<MainScriptEntry*> parent;
-#endif
-        void setNode(pugi::xml_node& parent) const;
-        bool operator==(const SubScriptEntry &other) const {
-          return (next == other.next);
-        }
-        bool operator!=(const SubScriptEntry &other) const { return !(*this == other); }
-    };
-    struct MainScriptEntry : OffsetTaggable
-    {
-        //raw data
-        int before = -1;             //Previous element, seems to be lineary incresiable
-        int index_sub_item = -1;     //Index of the first subitem element. Amount of child elements decided by the subitem's 'next' field
-        int next;               //Next element, seems to be lineary as well
-        int next_ticks;         //Denotes the element starting the next tag. Aka, all elements between this and 'next_ticks' ones are children of this.
-        int offset_unicode = -1;     //Points to the unicode string
-        //convenience data
-        //int power = 0;              //denoutes the level in the hierarchy. Derived from the 'next_ticks'
-        std::u16string unicode;
-#ifdef BXR_DEBUG_LINKS
-        MainScriptEntry* parent;
-        std::vector<MainScriptEntry *> children;
-#endif
-        std::vector<SubScriptEntry *> subscript_children;
-        void setNode(pugi::xml_node& parent, const std::string& property_name) const;
-        bool operator==(const MainScriptEntry &other) const {
-          return (before == other.before) && (next == other.next) &&
-                 (next_ticks == other.next_ticks) &&
-                 (index_sub_item == other.index_sub_item) &&
-                 (unicode == other.unicode);
-        }
-        bool operator!=(const MainScriptEntry &other) const { return !(*this == other); }
-    };
-private:
-#ifdef BXR_DEBUG_LINKS
-    std::vector<OffsetData<MainScriptEntry>> m_main_tags;
-    std::vector<OffsetData<SubScriptEntry>> m_sub_tags;
-#else
-    std::vector<Offsetable> m_main_tags;
-    std::vector<Offsetable> m_sub_tags;
-#endif
-    std::vector<MainScriptEntry*> m_root;
-    std::vector<MainScriptEntry> m_main_items;
-    std::vector<SubScriptEntry> m_sub_items;
+    std::vector<int32_t> m_main_tags; //symbol offsets of the tag names
+    std::vector<int32_t> m_sub_tags;
+    std::vector<MainRow> m_main_items;
+    std::vector<SubRow> m_sub_items;
+    std::vector<char> m_symbols;      //ANSI strings, padding to an even size, big-endian UTF-16 strings
     std::string m_property_name = "symbol"; //Property is treated as a subchild
                                             //It's tag added to the list and sorted alphabetically, thus defining order the value srtring are written for the main item
 
-    //size calculation
-    uint32_t getUnicodeSize() const;
-    uint32_t calculateStringSize() const;
-    //rebuilding
-    void setUnicodeData(std::vector<char>& output);
-    template<class T>
-    void insertIntoQueue(std::vector<T>& origin, std::vector<imas::file::BXR::Offsetable*>& output);
+    // Query indices: elements grouped by tag (offsets into m_tag_elements per
+    // tag id), parents, and per field (sub tag id, -1 for the property) the
+    // values sorted for binary search
+    mutable std::vector<int32_t> m_tag_offsets;
+    mutable std::vector<int32_t> m_tag_elements;
+    mutable std::vector<int32_t> m_parents;
+    mutable std::unordered_map<int32_t, std::vector<std::pair<std::string_view, int32_t>>> m_value_index;
 
-    // Manageable interface
+    std::string_view symbol(int32_t offset) const;
+    void buildElementIndex() const;
+    std::vector<std::pair<std::string_view, int32_t>> const& valueIndex(int32_t field_key) const;
+    std::optional<int32_t> fieldKey(std::string_view name) const;
+    bool matchesPath(int32_t element, std::vector<std::string_view> const& path, bool anchored) const;
+    std::vector<int32_t> candidates(std::vector<std::string_view> const& path, bool anchored) const;
+    void writeNode(utility::XmlWriter& writer, int32_t index, std::string& scratch) const;
 };
 
 } // namespace file
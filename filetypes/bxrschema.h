@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+// Optional tag vocabularies for BXR import. Files of the same kind share
+// their tags, so those can be hashed without collisions at compile time and
+// looked up with a single comparison. Tags missing from a schema still go
+// through the generic interning, so a schema never changes the output.
+// "bxrtool schema <file>" prints the declaration for a file's tags.
+
+namespace imas {
+namespace file {
+
+// FNV-1a with a seed, so the table can search for collision free seeds
+constexpr uint32_t schemaHash(std::string_view name, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (auto const c : name) {
+    hash ^= uint8_t(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Hash and displace: names are spread over buckets, and every bucket gets a
+// seed that puts its names into free slots. Names are kept sorted, so slot
+// order is also the order BXR sorts values in.
+template <size_t N>
+struct BXRSchemaTable {
+  static_assert(N > 0 && N < 0x8000);
+  static constexpr size_t bucket_count = std::bit_ceil(N);
+  static constexpr size_t slot_count = std::bit_ceil(N * 2);
+
+  std::array<std::string_view, N> names;
+  std::array<uint32_t, bucket_count> seeds{};
+  std::array<int16_t, slot_count> slots{};
+
+  consteval BXRSchemaTable(std::array<std::string_view, N> const &tag_names) : names(tag_names) {
+    std::ranges::sort(names);
+    if (std::ranges::adjacent_find(names) != names.end()) {
+      throw "duplicate tag in a BXR schema";
+    }
+    slots.fill(-1);
+    std::array<size_t, bucket_count> bucket_sizes{};
+    for (auto const name : names) {
+      ++bucket_sizes[bucket(name)];
+    }
+    // Crowded buckets first, while there is the most room
+    for (auto size = N; size > 0; --size) {
+      for (size_t b = 0; b < bucket_count; ++b) {
+        if (bucket_sizes[b] == size) {
+          placeBucket(b);
+        }
+      }
+    }
+  }
+
+private:
+  static constexpr size_t bucket(std::string_view name) {
+    return schemaHash(name, 0) & (bucket_count - 1);
+  }
+
+  consteval void placeBucket(size_t b) {
+    for (uint32_t seed = 1;; ++seed) {
+      auto trial = slots;
+      bool placed = true;
+      for (size_t i = 0; i < N && placed; ++i) {
+        if (bucket(names[i]) != b) {
+          continue;
+        }
+        auto &slot = trial[schemaHash(names[i], seed) & (slot_count - 1)];
+        placed = -1 == slot;
+        slot = int16_t(i);
+      }
+      if (placed) {
+        slots = trial;
+        seeds[b] = seed;
+        return;
+      }
+    }
+  }
+};
+
+// Size independent view of a table, as used by the importer
+struct BXRSchema {
+  std::string_view root; // first root tag of the files this schema is for
+  std::span<std::string_view const> names;
+  std::span<uint32_t const> seeds;
+  std::span<int16_t const> slots;
+
+  // Index of the tag in 'names', -1 for tags outside the schema
+  constexpr int32_t find(std::string_view name) const {
+    auto const seed = seeds[schemaHash(name, 0) & (seeds.size() - 1)];
+    auto const slot = slots[schemaHash(name, seed) & (slots.size() - 1)];
+    return -1 != slot && names[slot] == name ? slot : -1;
+  }
+};
+
+template <size_t N>
+constexpr BXRSchema makeSchema(std::string_view root, BXRSchemaTable<N> const &table) {
+  return {root, table.names, table.seeds, table.slots};
+}
+
+// Known vocabularies. Texture lists, see the sample in bxr.h.
+inline constexpr BXRSchemaTable<5> texture_schema_tags({"texture", "h", "id", "src", "w"});
+
+inline constexpr std::array known_schemas = {
+    makeSchema("texture", texture_schema_tags),
+};
+
+// Schema for files starting with 'root', nullptr if there is none
+inline BXRSchema const *findSchema(std::string_view root) {
+  auto const iter = std::ranges::find(known_schemas, root, &BXRSchema::root);
+  return iter != known_schemas.end() ? &*iter : nullptr;
+}
+
+} // namespace file
+} // namespace imas
@@ -0,0 +1,88 @@
+#include "gametext.h"
+
+#include "filetypes/bna.h"
+#include "filetypes/scb.h"
+#include "utility/hash.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace {
+constexpr auto archive_extension = ".bna";
+constexpr auto script_extension = "scb";
+
+uint64_t fileStamp(std::filesystem::directory_entry const &entry) {
+  uint64_t const values[] = {entry.file_size(),
+                             uint64_t(entry.last_write_time().time_since_epoch().count())};
+  return imas::utility::hash64({reinterpret_cast<char const *>(values), sizeof(values)});
+}
+
+void readArchive(std::filesystem::path const &gamepath, imas::file::ArchiveText &archive) {
+  imas::file::BNA bna;
+  if (auto const res = bna.loadFromFile(gamepath / archive.name); !res.first) {
+    archive.error = res.second;
+    return;
+  }
+  for (auto const &file : bna.getFiles(script_extension)) {
+    // The other sections are never touched
+    auto const section = imas::file::SCB::msgSection(file.get().file_data);
+    if (!section) {
+      archive.error = file.get().getFullPath() + ": no MSG section";
+      continue;
+    }
+    imas::file::MSG msg;
+    if (auto const res = msg.loadFromData(*section); !res.first) {
+      archive.error = file.get().getFullPath() + ": " + res.second;
+      continue;
+    }
+    auto &script = archive.scripts.emplace_back(file.get().getFullPath());
+    auto const &entries = msg.entries();
+    script.strings.reserve(entries.size());
+    for (auto const &entry : entries) {
+      script.strings.push_back(entry.data);
+    }
+  }
+}
+} // namespace
+
+namespace imas {
+namespace file {
+
+std::vector<ArchiveText> listArchives(std::filesystem::path const &gamepath) {
+  std::vector<ArchiveText> archives;
+  for (auto const &entry : std::filesystem::recursive_directory_iterator(gamepath)) {
+    if (entry.is_regular_file() && entry.path().extension() == archive_extension) {
+      archives.push_back({.name = std::filesystem::relative(entry.path(), gamepath).generic_string(),
+                          .stamp = fileStamp(entry),
+                          .scripts = {},
+                          .error = {}});
+    }
+  }
+  std::ranges::sort(archives, {}, &ArchiveText::name);
+  return archives;
+}
+
+void readArchiveText(std::filesystem::path const &gamepath, std::vector<ArchiveText> &archives,
+                     unsigned thread_count, std::function<bool(ArchiveText const &)> const &wanted) {
+  std::atomic_size_t next_archive = 0;
+  std::vector<std::jthread> workers;
+  for (unsigned i = 0; i < std::max(1u, thread_count); ++i) {
+    workers.emplace_back([&] {
+      for (auto index = next_archive++; index < archives.size(); index = next_archive++) {
+        auto &archive = archives[index];
+        if (wanted && !wanted(archive)) {
+          continue;
+        }
+        try {
+          readArchive(gamepath, archive);
+        } catch (std::exception const &e) {
+          archive.error = e.what();
+        }
+      }
+    });
+  }
+}
+
+} // namespace file
+} // namespace imas
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+// MSG strings of a whole game folder, for indexing tools. Archives are read
+// in parallel, and each script keeps its strings in file order.
+
+namespace imas {
+namespace file {
+
+struct ScriptText {
+  std::string subfile; // path inside the archive
+  std::vector<std::u16string> strings;
+};
+
+struct ArchiveText {
+  std::string name; // path relative to the game folder, '/' separated
+  uint64_t stamp;   // changes along with the file's size or write time
+  std::vector<ScriptText> scripts;
+  std::string error; // set when the archive or one of its scripts failed to load
+};
+
+// BNA files under 'gamepath', sorted by name, with nothing read yet
+std::vector<ArchiveText> listArchives(std::filesystem::path const &gamepath);
+// Fills 'scripts' of the archives 'wanted' accepts, or of all of them
+void readArchiveText(std::filesystem::path const &gamepath, std::vector<ArchiveText> &archives,
+                     unsigned thread_count,
+                     std::function<bool(ArchiveText const &)> const &wanted = {});
+
+} // namespace file
+} // namespace imas
@@ -6,6 +6,7 @@
 #include <fstream>
 #include <map>
 #include <memory>
+#include <span>
 #include <spanstream>
 #include <string>
 #include <vector>
@@ -27,9 +28,8 @@ public:
 
   virtual Fileapi api() const = 0;
   // initialisation methods
-  Result loadFromData(std::vector<char> const &data) {
-    std::ispanstream stream(data);
-    return openFromStream(&stream);
+  Result loadFromData(std::span<char const> data) {
+    return openFromData(data);
   }
   Result loadFromFile(std::filesystem::path const &filename) {
     std::ifstream stream(filename, std::ios_base::binary);
@@ -38,10 +38,14 @@ public:
     }
     return openFromStream(&stream);
   }
+  // Rendered into a fresh buffer, since the object may still view 'data'
   Result saveToData(std::vector<char> &data) {
-    data.resize(size());
-    std::ospanstream stream(data);
-    return saveToStream(&stream);
+    std::vector<char> output;
+    auto const result = saveToBuffer(output);
+    if (result.first) {
+      data = std::move(output);
+    }
+    return result;
   }
   Result saveToFile(std::filesystem::path const &filename) {
     std::ofstream stream(filename, std::ios_base::binary);
@@ -56,7 +60,19 @@ public:
   virtual Result
   inject(std::filesystem::path const &openpath) = 0;
 protected:
+  // Types that can parse a buffer directly override this, the rest read it
+  // through a stream
+  virtual Result openFromData(std::span<char const> data) {
+    std::ispanstream stream(data);
+    return openFromStream(&stream);
+  }
   virtual Result openFromStream(std::basic_istream<char> *stream) = 0;
+  // Same for saving into memory
+  virtual Result saveToBuffer(std::vector<char> &output) {
+    output.resize(size());
+    std::ospanstream stream(output);
+    return saveToStream(&stream);
+  }
   virtual Result saveToStream(std::basic_ostream<char> *stream) = 0;
   virtual size_t size() const = 0; //size of the output file
 };
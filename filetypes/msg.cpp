@@ -1,13 +1,18 @@
 #include "msg.h"
+#include "filetypes/translationmemory.h"
 #include "utility/stringtools.h"
+#include "utility/xlsx.h"
 
 #include <ranges>
 #include <utility/streamtools.h>
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <format>
+#include <iterator>
 #include <numeric>
 
-#include <OpenXLSX.hpp>
-
 namespace {
 constexpr char padding_literal = 0xCD;
 constexpr auto offset_data_size = 0x10;
@@ -43,10 +48,13 @@ uint32_t MSG::headerSize() const {
   return 16 + (entry_count % 2 ? (entry_count * 8) + 8 : (entry_count * 8));
 }
 
+// ANSI files store one byte per character
+uint32_t MSG::charSize() const { return m_flags & msg_encoding_flag ? 1 : 2; }
+
 uint32_t MSG::stringsSize() const {
   return std::accumulate(m_entries.begin(), m_entries.end(), 0,
-                         [](const auto &a, const auto &b) {
-                           return a + ((b.data.size() + 1) * 2);
+                         [this](const auto &a, const auto &b) {
+                           return a + ((b.data.size() + 1) * charSize());
                          });
 }
 
@@ -69,44 +77,63 @@ Manageable::Fileapi MSG::api() const {
   return api;
 }
 
+// The sheet layout is fixed, so it is streamed straight into the sheet XML
 Result MSG::extract(std::filesystem::path const &filepath) const {
-  OpenXLSX::XLDocument doc;
-  doc.create(filepath.string(), true);
-
-  auto wks = doc.workbook().worksheet("Sheet1");
-
-  wks.row(1).values() =
-      std::vector<std::string>{"name", "text", "translated", "note", "issues"};
-
-  WidestringConv converter;
-
-  for (auto const &[index, entry] : std::views::enumerate(m_entries)) {
-    wks.cell(index + 2, msg_export_column).value() =
-        converter.to_bytes(entry.data);
+  utility::XlsxWriter workbook;
+  workbook.addRow({"name", "text", "translated", "note", "issues"});
+  std::string text;
+  std::array<std::string_view, msg_export_column> row{};
+  for (auto const &entry : m_entries) {
+    text.clear();
+    utility::appendUtf8FromUtf16(text, entry.data);
+    row[msg_export_column - 1] = text;
+    workbook.addRow(row);
   }
-
-  doc.save();
-  return {true, ""};
+  return workbook.save(filepath);
 }
 
+// Only the import column is decoded, straight into UTF-16
 Result MSG::inject(std::filesystem::path const &filepath) {
-  OpenXLSX::XLDocument doc;
-  doc.open(filepath.string());
+  utility::XlsxReader workbook;
+  if (auto const result = workbook.open(filepath); !result.first) {
+    return result;
+  }
 
-  if (!doc.isOpen()) {
-    return {false, "failed to open file"};
+  // Row 1 holds the column names
+  std::vector<std::u16string> new_strings(m_entries.size());
+  auto const result = workbook.readColumn(msg_import_column - 1, [&](int row, std::string_view text) {
+    if (row >= 2 && size_t(row - 2) < new_strings.size()) {
+      utility::appendUtf16FromUtf8(new_strings[row - 2], text);
+    }
+  });
+  if (!result.first) {
+    return result;
   }
+  return setStrings(std::move(new_strings));
+}
 
-  auto wks = doc.workbook().worksheet("Sheet1");
+void MSG::setImportOptions(MSGImportOptions const &options) { m_import_options = options; }
 
-  WidestringConv converter;
+void MSG::reset() {
+  m_entries.clear();
+  m_flags = 0;
+}
 
-  std::vector<std::u16string> new_strings;
-  for (auto const &cell :
-       wks.range(OpenXLSX::XLCellReference(2, msg_import_column),
-                 OpenXLSX::XLCellReference(1 + m_entries.size(),
-                                           msg_import_column))) {
-    new_strings.emplace_back(converter.from_bytes(cell.getString()));
+Result MSG::setStrings(std::vector<std::u16string> new_strings) {
+  if (new_strings.size() != m_entries.size()) {
+    return {false, std::format("expected {} strings, got {}", m_entries.size(), new_strings.size())};
+  }
+
+  // Rows left empty take the translation memory's translation of the line
+  if (m_import_options.memory) {
+    std::string source;
+    for (auto [entry, string] : std::views::zip(m_entries, new_strings)) {
+      if (string.empty()) {
+        source.clear();
+        utility::appendUtf8FromUtf16(source, entry.data);
+        utility::appendUtf16FromUtf8(string, m_import_options.memory->translate(source));
+      }
+    }
   }
 
   if (std::ranges::all_of(new_strings,
@@ -114,90 +141,119 @@ Result MSG::inject(std::filesystem::path const &filepath) {
     return {false, "import column empty"};
   }
 
+  if (charSize() == 1 && std::ranges::any_of(new_strings, [](auto const &string) {
+        return std::ranges::any_of(string, [](char16_t c) { return c > 0xFF; });
+      })) {
+    return {false, "text has characters an ANSI MSG can't store"};
+  }
+
   if (std::ranges::equal(m_entries, new_strings, {}, &MSGEntry::data)) {
     return {false, "import data already present"};
   }
 
   for (auto [entry, string] : std::views::zip(m_entries, new_strings)) {
-    entry.data = string;
+    entry.data = std::move(string);
   }
 
   return {true, ""};
 }
 
 Result MSG::openFromStream(std::basic_istream<char> *stream) {
-  std::string label;
-  label.resize(4);
-  stream->read(label.data(), 4);
-  stream->seekg(msg_count_offset);
-  auto const count = imas::utility::readShort(stream);
-  imas::utility::readToValue(stream, m_flags);
-  m_entries.resize(count);
-  stream->seekg(msg_header_offset);
-  for (auto &entry : m_entries) {
-    entry.map.size = imas::utility::readLong(stream);
-    entry.map.offset = imas::utility::readLong(stream);
+  std::vector<char> const data{std::istreambuf_iterator<char>(*stream), {}};
+  return openFromData(data);
+}
+
+// Parsed straight from memory: every string is one copy plus a block byte
+// swap, or a widening pass for ANSI
+Result MSG::openFromData(std::span<char const> data) {
+  reset();
+  if (data.size() < msg_header_offset) {
+    return {false, "file is too small for an MSG header"};
   }
-  imas::utility::evenReadStream(stream);
+  auto const count = utility::loadValue<int16_t>(data.data() + msg_count_offset);
+  m_flags = utility::loadValue<uint32_t>(data.data() + msg_count_offset + 2);
   // msg uses offsets relative to the zero point.
   // Moreover, zero point is not defined in the header, so i'm just gonna assume
   // it goes straight after header
-  size_t const zero_point = stream->tellg();
-  bool const ansi = m_flags & msg_encoding_flag;
+  size_t const zero_point = padValue(msg_header_offset + std::max<int16_t>(count, 0) * 8, 0x10);
+  if (count < 0 || zero_point > data.size()) {
+    return {false, "MSG string table is out of bounds"};
+  }
+  m_entries.resize(count);
+  auto entry_data = data.data() + msg_header_offset;
   for (auto &entry : m_entries) {
-    stream->seekg(zero_point + entry.map.offset);
+    entry.map.size = utility::loadValue<int32_t>(entry_data);
+    entry.map.offset = utility::loadValue<int32_t>(entry_data + 4);
+    entry_data += 8;
+  }
+  bool const ansi = charSize() == 1;
+  for (auto &entry : m_entries) {
+    if (entry.map.size < 1 || zero_point + uint64_t(entry.map.offset) + entry.map.size > data.size()) {
+      m_entries.clear();
+      return {false, "MSG string is out of bounds"};
+    }
+    auto const string = data.data() + zero_point + entry.map.offset;
     // Let's strip terminating character from the string
     if (ansi) {
-      entry.data.resize((entry.map.size - 1));
-      for (auto &wide : entry.data) {
-        stream->read((char *)&wide, 1);
-      }
+      auto const bytes = reinterpret_cast<uint8_t const *>(string);
+      entry.data.assign(bytes, bytes + entry.map.size - 1);
     } else {
       entry.data.resize((entry.map.size - 1) / 2);
-      for (auto &wide : entry.data) {
-        wide = imas::utility::readShort(stream);
-      }
+      std::memcpy(entry.data.data(), string, entry.data.size() * 2);
+      utility::byteswapRange16(std::as_writable_bytes(std::span(entry.data)));
     }
   }
   return {true, ""};
 }
 
-Result MSG::saveToStream(std::basic_ostream<char>* stream) {
+// Layout is known up front, so everything goes into one buffer
+void MSG::write(std::vector<char> &output) const {
+  output.clear();
+  output.reserve(size());
   // Let's fill header
-  stream->write("MSG", 3);
-  utility::padStream(stream, 0, 12);
-  stream->put(0x45);
-  utility::padStream(stream, 0, 16);
-  // Write string count
-  utility::writeFromValue(stream, m_entries.size()); // string count
-  utility::writeFromValue(stream, m_flags);
-  int16_t const str_size = stringsSize();
-  utility::writeFromValue(stream, str_size); // string data size
-  utility::writeFromValue(stream,
-                      0x10); // idk what this does, seems to be always 0x10
-  int16_t const header_size = headerSize();
-  utility::writeFromValue(stream, header_size); // header size
-  utility::padStream(stream, 0, 4);
+  output.insert(output.end(), {'M', 'S', 'G'});
+  output.resize(0x0F, 0);
+  output.push_back(0x45);
+  utility::appendValue(output, int32_t(size() - 32));
+  output.resize(msg_count_offset, 0);
+  utility::appendValue(output, int16_t(m_entries.size())); // string count
+  utility::appendValue(output, m_flags);
+  utility::appendValue(output, int16_t(stringsSize())); // string data size
+  utility::appendValue(output, int16_t(0x10)); // idk what this does, seems to be always 0x10
+  utility::appendValue(output, int16_t(headerSize()));
+  output.resize(msg_header_offset, 0);
   int32_t text_offset = 0;
   for (auto const &string : m_entries) {
-    int32_t const str_size = (string.data.size() + 1) * 2;
-    utility::writeFromValue(stream, str_size);
-    utility::writeFromValue(stream, text_offset);
+    int32_t const str_size = (string.data.size() + 1) * charSize();
+    utility::appendValue(output, str_size);
+    utility::appendValue(output, text_offset);
     text_offset += str_size;
   }
-  utility::evenWriteStream(stream, padding_literal);
+  utility::appendPadding(output, padding_literal);
   for (auto const &string : m_entries) {
-    for (auto const &wide : string.data) {
-      utility::writeFromValue(stream, wide);
+    if (charSize() == 1) {
+      // Imported text was checked to fit a byte per character
+      std::ranges::transform(string.data, std::back_inserter(output),
+                             [](char16_t c) { return char(c); });
+    } else {
+      utility::appendRange(output, std::span<char16_t const>(string.data));
     }
     // Add terminating character to the string
-    utility::writeFromValue(stream, wchar_t('\0'));
+    output.insert(output.end(), charSize(), '\0');
   }
   // Finalizing
-  utility::evenWriteStream(stream, padding_literal);
-  int32_t const size = int32_t(stream->tellp()) - 32;
-  stream->seekp(offset_data_size);
-  utility::writeFromValue(stream, size);
+  utility::appendPadding(output, padding_literal);
+}
+
+Result MSG::saveToBuffer(std::vector<char> &output) {
+  write(output);
+  return {true, ""};
+}
+
+Result MSG::saveToStream(std::basic_ostream<char>* stream) {
+  std::vector<char> buffer;
+  write(buffer);
+  stream->write(buffer.data(), buffer.size());
   return {true, ""};
 }
 
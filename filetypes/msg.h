@@ -13,6 +13,12 @@ struct MSGEntry {
   std::u16string data;
 };
 
+class TranslationMemory;
+
+struct MSGImportOptions {
+  TranslationMemory const *memory = nullptr; // fills the lines a workbook leaves empty
+};
+
 constexpr int32_t msg_label_size = 0x10;
 constexpr int32_t msg_count_offset = 0x20;
 constexpr int32_t msg_header_offset = 0x30;
@@ -24,16 +30,28 @@ public:
   Fileapi api() const override;
   Result extract(std::filesystem::path const &filename) const override;
   Result inject(std::filesystem::path const &csv) override;
+  std::vector<MSGEntry> const &entries() const { return m_entries; }
+  // Replaces the text of all entries, one string per entry, as inject does
+  Result setStrings(std::vector<std::u16string> new_strings);
+  void setImportOptions(MSGImportOptions const &options);
+  // Drops the entries, import options are kept
+  void reset();
+  // Renders the file into 'output', as saveToStream would write it
+  void write(std::vector<char> &output) const;
 
 private:
+  Result openFromData(std::span<char const> data) override;
   Result openFromStream(std::basic_istream<char> *stream) override;
+  Result saveToBuffer(std::vector<char> &output) override;
   Result saveToStream(std::basic_ostream<char> *stream) override;
   std::vector<MSGEntry> m_entries;
   uint32_t headerSize() const;
+  uint32_t charSize() const;
   uint32_t stringsSize() const;
   size_t size() const override;
   //header
   uint32_t m_flags; //potentially holds string type
+  MSGImportOptions m_import_options;
 };
 
 } // namespace file
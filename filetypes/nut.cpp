@@ -1,9 +1,17 @@
 #include "nut.h"
+#include "texturecache.h"
 
 #include <utility/datatools.h>
+#include <utility/dxt.h>
+#include <utility/hash.h>
 #include <utility/streamtools.h>
 
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <fstream>
+#include <optional>
+#include <spanstream>
 
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/iostreams/stream.hpp>
@@ -24,20 +32,91 @@ void changeEndian4(std::vector<char> &target) {
   }
 }
 
+std::optional<imas::utility::BlockFormat> blockFormat(int pixel_type) {
+  switch (pixel_type) {
+    case 0:
+      return imas::utility::BlockFormat::bc1;
+    case 1:
+      return imas::utility::BlockFormat::bc2;
+    case 2:
+      return imas::utility::BlockFormat::bc3;
+    default:
+      return {};
+  }
+}
+
+int levelDimension(int base, int mip_level) {
+  return std::max(1, base >> mip_level);
+}
+
+// Size of a single mipmap level in bytes. 0 for unknown formats.
+size_t levelSize(int pixel_type, int width, int height) {
+  if (auto const format = blockFormat(pixel_type)) {
+    return imas::utility::surfaceSize(*format, width, height);
+  }
+  if (pixel_type == 19 || pixel_type == 20) {
+    return size_t(width) * height * 4;
+  }
+  return 0;
+}
+
+// Bump whenever importDDS or generateMipmaps produce different bytes, so
+// cache entries of older builds stop matching
+constexpr uint64_t texture_cache_version = 1;
+
+// A cached texture is only used when its payload is exactly its mipmap chain
+bool cachedTextureValid(imas::file::CachedTexture const &texture) {
+  size_t size = 0;
+  for (int level = 0; level < texture.nMipmap; ++level) {
+    auto const level_size = levelSize(texture.pixel_type, levelDimension(texture.width, level),
+                                      levelDimension(texture.height, level));
+    if (0 == level_size) {
+      return false;
+    }
+    size += level_size;
+  }
+  return size == texture.raw_texture.size();
+}
+
+// NUT stores 32-bit pixels as big-endian ARGB
+void decodeARGB(std::span<char const> data, bool opaque, imas::utility::Image &image) {
+  auto source = reinterpret_cast<uint8_t const *>(data.data());
+  auto target = image.pixels.data();
+  auto const end = target + image.pixels.size();
+  for (; target != end; source += 4, target += 4) {
+    target[0] = source[1];
+    target[1] = source[2];
+    target[2] = source[3];
+    target[3] = opaque ? 0xFF : source[0];
+  }
+}
 
+void encodeARGB(imas::utility::Image const &image, std::vector<char> &output) {
+  auto const start = output.size();
+  output.resize(start + image.pixels.size());
+  auto source = image.pixels.data();
+  auto target = output.data() + start;
+  auto const end = source + image.pixels.size();
+  for (; source != end; source += 4, target += 4) {
+    target[0] = source[3];
+    target[1] = source[0];
+    target[2] = source[1];
+    target[3] = source[2];
+  }
+}
 
 }
 
 namespace imas {
 namespace file {
 
-const std::filesystem::__cxx11::path TextureData::getFilePath(const std::filesystem::__cxx11::path& path) const {
+const std::filesystem::__cxx11::path TextureData::getFilePath(const std::filesystem::__cxx11::path& path, std::string const& extension) const {
   std::ostringstream fname_steam;
-  fname_steam << path.filename().string() << "_" << gidx.GIDX << ".dds";
+  fname_steam << path.filename().string() << "_" << gidx.GIDX << extension;
   return path.parent_path() / fname_steam.str();
 }
 
-bool TextureData::load(std::basic_istream<char> *stream) {
+bool TextureData::load(std::basic_istream<char> *stream, std::span<char const> arena) {
   // texture header
   int texture_data_size = utility::readLong(stream);
   unknown0 = utility::readLong(stream); // always 0
@@ -58,8 +137,10 @@ bool TextureData::load(std::basic_istream<char> *stream) {
 
   stream->ignore(6 * 4);
 
+  if (nMipmap > max_mipmap_count) {
+    return false;
+  }
   if (nMipmap > 1) {
-    mipmap_size.resize(nMipmap);
     for (int i = 0; i < nMipmap; i++) {
       mipmap_size[i] = utility::readLong(stream);
     }
@@ -94,52 +175,60 @@ bool TextureData::load(std::basic_istream<char> *stream) {
   gidx.GIDX = utility::readLong(stream);
   gidx.unknown12 = utility::readLong(stream); // always 0
 
-  raw_texture.resize(image_data_size);
-  stream->read(raw_texture.data(), image_data_size);
+  size_t const position = stream->tellg();
+  if (!*stream || image_data_size < 0 || position + image_data_size > arena.size()) {
+    return false;
+  }
+  raw_texture.view(arena.subspan(position, image_data_size));
+  stream->seekg(image_data_size, std::ios_base::cur);
   return true;
 }
 
-void TextureData::write(std::basic_ostream<char> *stream) {
+void TextureData::write(std::vector<char>& output) const {
   auto const header_size = headerSize();
 
   int32_t const image_data_size = raw_texture.size();
   int32_t const texture_data_size = header_size + image_data_size;
 
-  utility::writeLong(stream, texture_data_size);
-  utility::writeLong(stream, unknown0);
-  utility::writeLong(stream, image_data_size);
-  utility::writeShort(stream, header_size);
-  utility::writeShort(stream, unknown1);
-  utility::writeShort(stream, nMipmap);
-  utility::writeShort(stream, pixel_type);
-  utility::writeShort(stream, width);
-  utility::writeShort(stream, height);
-
-  utility::padStream(stream, 0, 6 * 4);
-
-  if (mipmap_size.size() > 1) {
-    for (int i = 0; i < mipmap_size.size(); i++) {
-      utility::writeLong(stream, mipmap_size[i]);
+  utility::appendValue<int32_t>(output, texture_data_size);
+  utility::appendValue<int32_t>(output, unknown0);
+  utility::appendValue<int32_t>(output, image_data_size);
+  utility::appendValue<int16_t>(output, header_size);
+  utility::appendValue<int16_t>(output, unknown1);
+  utility::appendValue<int16_t>(output, nMipmap);
+  utility::appendValue<int16_t>(output, pixel_type);
+  utility::appendValue<int16_t>(output, width);
+  utility::appendValue<int16_t>(output, height);
+
+  output.resize(output.size() + 6 * 4);
+
+  if (auto const sizes = mipmaps(); !sizes.empty()) {
+    for (auto const size : sizes) {
+      utility::appendValue(output, size);
     }
-    utility::evenWriteStream(stream);
-    //pFile->WriteNullArray((16 - mipmap_size.size() % 16) % 16);
+    utility::appendPadding(output);
   }
 
-  stream->write("eXt\0", 4);
-  utility::writeLong(stream, ext.param1);
-  utility::writeLong(stream, ext.param2);
-  utility::writeLong(stream, ext.param3);
+  output.insert(output.end(), {'e', 'X', 't', '\0'});
+  utility::appendValue<int32_t>(output, ext.param1);
+  utility::appendValue<int32_t>(output, ext.param2);
+  utility::appendValue<int32_t>(output, ext.param3);
+
+  output.insert(output.end(), {'G', 'I', 'D', 'X'});
+  utility::appendValue<int32_t>(output, gidx.unknown11);
+  utility::appendValue<int32_t>(output, gidx.GIDX);
+  utility::appendValue<int32_t>(output, gidx.unknown12);
 
-  stream->write("GIDX", 4);
-  utility::writeLong(stream, gidx.unknown11);
-  utility::writeLong(stream, gidx.GIDX);
-  utility::writeLong(stream, gidx.unknown12);
+  output.insert(output.end(), raw_texture.data(), raw_texture.data() + raw_texture.size());
+}
 
-  stream->write(raw_texture.data(), raw_texture.size());
+std::span<int32_t const> TextureData::mipmaps() const {
+  return {mipmap_size.data(), size_t(nMipmap > 1 ? nMipmap : 0)};
 }
 
 int16_t TextureData::headerSize() const {
-  return 48 + (mipmap_size.size() > 1 ? ((mipmap_size.size() - 1) / 16 + 1) * 16 : 0) + 16 + 16;
+  // The mipmap table is padded to 16 bytes, same as load() skips it
+  return 48 + (nMipmap > 1 ? (nMipmap * 4 + 15) / 16 * 16 : 0) + 16 + 16;
 }
 
 int32_t TextureData::calculateSize() const {
@@ -154,7 +243,8 @@ boost::json::value TextureData::toJson() const {
   root["size"] = raw_texture.size();
   boost::json::object mipmap;
   mipmap["size"] = nMipmap;
-  boost::json::array m_array(mipmap_size.begin(), mipmap_size.end());
+  auto const sizes = mipmaps();
+  boost::json::array m_array(sizes.begin(), sizes.end());
   mipmap["array"] = m_array;
   root["mipmap"] = mipmap;
   root["eXt"] = { { "param1", ext.param1 }, { "param2", ext.param2 }, { "param3", ext.param3 } };
@@ -170,11 +260,17 @@ Result TextureData::fromJson(boost::json::value const& value) {
     height = root["height"].as_int64();
     auto mipmap = root["mipmap"].as_object();
     nMipmap = mipmap["size"].as_int64();
+    if(nMipmap > max_mipmap_count) {
+      return {false, "Too many mipmaps: " + std::to_string(nMipmap)};
+    }
     if(nMipmap > 1) {
       auto const mipmaps = mipmap["array"].as_array() | boost::adaptors::transformed([](boost::json::value& value){
                        return value.as_int64();
                      });
-      mipmap_size.assign(mipmaps.begin(), mipmaps.end());
+      if(std::ranges::distance(mipmaps) != nMipmap) {
+        return {false, "Mipmap table doesn't match the mipmap count"};
+      }
+      std::ranges::copy(mipmaps, mipmap_size.begin());
     }
 
     auto ext_value = root["eXt"].as_object();
@@ -239,7 +335,7 @@ Result TextureData::exportDDS(std::filesystem::path const& extract_dir_path) con
   dds_data.resize(sizeof(header) + raw_texture.size());
   memcpy(&dds_data[0], &header, sizeof(header));
 
-  auto texture_tmp = raw_texture;
+  std::vector<char> texture_tmp(raw_texture.span().begin(), raw_texture.span().end());
   int pixel_type = pixel_type;
   if (pixel_type == 0 || pixel_type == 1 || pixel_type == 2) {
     if (0 != texture_tmp.size() % 2) {
@@ -266,24 +362,42 @@ Result TextureData::exportDDS(std::filesystem::path const& extract_dir_path) con
 }
 
 //Replaces the contents of the texture with the contents of the DDS file
-Result TextureData::importDDS(const std::filesystem::path& filepath)
+Result TextureData::importDDS(const std::filesystem::path& filepath, ImportOptions const& options)
 {
   std::ifstream stream(filepath, std::ios_base::binary);
   if (!stream.is_open()) {
     return {false, "Failed to open the file."};
   }
+  std::vector<char> file_data(std::filesystem::file_size(filepath));
+  stream.read(file_data.data(), file_data.size());
+  if (file_data.size() < sizeof(DDS_HEADER)) {
+    return {false, "Not a DDS file."};
+  }
+  uint64_t cache_key = 0;
+  if (options.cache) {
+    cache_key = utility::hash64(file_data, texture_cache_version << 1 | options.generate_mipmaps);
+    if (auto const cached = options.cache->find(cache_key); cached && cachedTextureValid(*cached)) {
+      pixel_type = cached->pixel_type;
+      width = cached->width;
+      height = cached->height;
+      nMipmap = cached->nMipmap;
+      raw_texture.assign(std::vector<char>(cached->raw_texture));
+      updateMipmapSizes();
+      return {true, filepath.string()};
+    }
+  }
   DDS_HEADER header;
-  stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+  std::memcpy(&header, file_data.data(), sizeof(header));
   if (header.dwMagic != ' SDD') {
     return {false, "Not a DDS file."};
   }
   width = header.dwWidth;
   height = header.dwHeight;
-  nMipmap = header.dwMipMapCount;
-  mipmap_size.resize(nMipmap);
-  auto const texture_size = std::filesystem::file_size(filepath) - sizeof(DDS_HEADER);
-  raw_texture.resize(texture_size);
-  stream.read(raw_texture.data(), texture_size);
+  nMipmap = std::max(1, header.dwMipMapCount);
+  if (nMipmap > max_mipmap_count) {
+    return {false, "Too many mipmaps."};
+  }
+  std::vector<char> texture(file_data.begin() + sizeof(DDS_HEADER), file_data.end());
   switch (header.ddpfPixelFormat.dwFourCC)
   {
     case '1TXD':
@@ -302,19 +416,119 @@ Result TextureData::importDDS(const std::filesystem::path& filepath)
       return {false, "Not a DDS file."};
   }
   if (pixel_type == 0 || pixel_type == 1 || pixel_type == 2) {
-    if (0 != raw_texture.size() % 2) {
+    if (0 != texture.size() % 2) {
       return {false, "Wrong texture block size. (Texture size should be power of 2)"};
     }
-    changeEndian2(raw_texture);
+    changeEndian2(texture);
   } else {
-    if (0 != raw_texture.size() % 4) {
+    if (0 != texture.size() % 4) {
       return {false, "Wrong texture block size. (Texture size should be power of 4)"};
     }
-    changeEndian4(raw_texture);
+    changeEndian4(texture);
+  }
+  raw_texture.assign(std::move(texture));
+  if (options.generate_mipmaps) {
+    if (auto const res = generateMipmaps(); !res.first) {
+      return res;
+    }
+  }
+  updateMipmapSizes();
+  if (options.cache) {
+    options.cache->insert(cache_key, {pixel_type, width, height, nMipmap, {raw_texture.span().begin(), raw_texture.span().end()}});
   }
   return {true, filepath.string()};
 }
 
+//Rebuilds the full mipmap chain out of the base level, dropping the old levels
+Result TextureData::generateMipmaps()
+{
+  utility::Image image;
+  if (auto const res = decode(image, 0); !res.first) {
+    return res;
+  }
+  auto texture = raw_texture.take();
+  texture.resize(levelSize(pixel_type, width, height));
+  nMipmap = std::min(utility::mipmapCount(width, height), max_mipmap_count);
+  auto const format = blockFormat(pixel_type);
+  for (int level = 1; level < nMipmap; ++level) {
+    image = utility::downsample(image);
+    if (format) {
+      utility::encodeBlocks(image, *format, texture, true);
+    } else {
+      encodeARGB(image, texture);
+    }
+  }
+  raw_texture.assign(std::move(texture));
+  return {true, ""};
+}
+
+// Compares everything importDDS may replace
+bool TextureData::sameImage(TextureData const& other) const
+{
+  return pixel_type == other.pixel_type && width == other.width && height == other.height &&
+         std::max(nMipmap, 1) == std::max(other.nMipmap, 1) &&
+         std::ranges::equal(raw_texture.span(), other.raw_texture.span());
+}
+
+void TextureData::takeImage(TextureData&& other)
+{
+  pixel_type = other.pixel_type;
+  width = other.width;
+  height = other.height;
+  nMipmap = other.nMipmap;
+  mipmap_size = other.mipmap_size;
+  raw_texture = std::move(other.raw_texture);
+}
+
+void TextureData::updateMipmapSizes()
+{
+  mipmap_size.fill(0);
+  for (int level = 0; nMipmap > 1 && level < nMipmap; ++level) {
+    mipmap_size[level] = levelSize(pixel_type, levelDimension(width, level), levelDimension(height, level));
+  }
+}
+
+Result TextureData::decode(utility::Image& image, int mip_level) const
+{
+  if (mip_level < 0 || mip_level >= std::max(nMipmap, 1)) {
+    return {false, "Mipmap level " + std::to_string(mip_level) + " is out of range."};
+  }
+  size_t offset = 0;
+  for (int level = 0; level < mip_level; ++level) {
+    offset += levelSize(pixel_type, levelDimension(width, level), levelDimension(height, level));
+  }
+  auto const level_width = levelDimension(width, mip_level);
+  auto const level_height = levelDimension(height, mip_level);
+  auto const size = levelSize(pixel_type, level_width, level_height);
+  if (0 == size) {
+    return {false, "Unsupported pixel type " + std::to_string(pixel_type) + "."};
+  }
+  if (offset + size > raw_texture.size()) {
+    return {false, "Texture data is too short for the requested mipmap level."};
+  }
+  std::span<char const> const data(raw_texture.data() + offset, size);
+  if (auto const format = blockFormat(pixel_type)) {
+    utility::decodeBlocks(data, *format, level_width, level_height, image, true);
+  } else {
+    image.resize(level_width, level_height);
+    decodeARGB(data, pixel_type == 19, image);
+  }
+  return {true, ""};
+}
+
+Result TextureData::exportPNG(std::filesystem::path const& extract_dir_path, int mip_level) const
+{
+  utility::Image image;
+  if (auto const res = decode(image, mip_level); !res.first) {
+    return res;
+  }
+  auto final_path = getFilePath(extract_dir_path, ".png");
+  if (mip_level) {
+    final_path.replace_filename(final_path.stem().string() + "_mip" + std::to_string(mip_level) + ".png");
+  }
+  return utility::savePNG(image, final_path);
+}
+
 Result NUT::openFromStream(std::basic_istream<char> *stream) {
   if (utility::readLong(stream) != 'NTXR') {
     return {false, "Wrong signature in the file. Probably not a NUT file."};
@@ -330,10 +544,22 @@ Result NUT::openFromStream(std::basic_istream<char> *stream) {
   unknown3 = utility::readShort(stream); // always 0
   unknown4 = utility::readShort(stream); // always 0
 
+  // Everything past the header is read at once, the textures only keep views into it
+  auto const start = stream->tellg();
+  stream->seekg(0, std::ios_base::end);
+  auto const end = stream->tellg();
+  stream->seekg(start);
+  texture_arena.resize(end - start);
+  stream->read(texture_arena.data(), texture_arena.size());
+
+  std::ispanstream arena_stream(texture_arena);
   texture_data.resize(texture_count);
   for (int i = 0; i < texture_count; i++) {
-    texture_data[i].load(stream);
+    if (!texture_data[i].load(&arena_stream, texture_arena)) {
+      return {false, "Failed to read texture " + std::to_string(i) + "."};
+    }
   }
+  updateSize();
 
   return {true, "successfully loaded NUT file"};
 }
@@ -343,18 +569,22 @@ Result NUT::saveToStream(std::basic_ostream<char> *stream) {
     return {false, "no texture data to save"};
   }
 
-  stream->write("NTXR", 4);
+  // The file is assembled in memory and written in one go
+  std::vector<char> output;
+  output.reserve(size());
+  output.insert(output.end(), {'N', 'T', 'X', 'R'});
 
-  utility::writeShort(stream, unknown0);
-  utility::writeShort(stream, texture_data.size());
-  utility::writeShort(stream, unknown1);
-  utility::writeShort(stream, unknown2);
-  utility::writeShort(stream, unknown3);
-  utility::writeShort(stream, unknown4);
+  utility::appendValue<int16_t>(output, unknown0);
+  utility::appendValue<int16_t>(output, texture_data.size());
+  utility::appendValue<int16_t>(output, unknown1);
+  utility::appendValue<int16_t>(output, unknown2);
+  utility::appendValue<int16_t>(output, unknown3);
+  utility::appendValue<int16_t>(output, unknown4);
 
-  for (int i = 0; i < texture_data.size(); i++) {
-    texture_data[i].write(stream);
+  for (auto const& texture : texture_data) {
+    texture.write(output);
   }
+  stream->write(output.data(), output.size());
   return {true, "successfully saved NUT file"};
 }
 
@@ -394,23 +624,53 @@ Result NUT::extract(std::filesystem::path const& savepath) const {
   return {true, result_str.str()};
 }
 
+Result NUT::exportPNG(std::filesystem::path const& savepath, int mip_level) const {
+  std::stringstream result_str;
+  result_str << "Exporting " << texture_data.size() << " textures to PNG format..." << std::endl << "Exported files:\n";
+  for (auto const& texture : texture_data) {
+    auto const level = std::min(mip_level, std::max(texture.nMipmap, 1) - 1);
+    if(auto const res = texture.exportPNG(savepath, level); res.first){
+      result_str << res.second << '\n';
+    }else{
+      return res;
+    }
+  }
+  return {true, result_str.str()};
+}
+
 Result NUT::inject(const std::filesystem::path& dirpath) {
   size_t texture_count = 0;
+  size_t unchanged_count = 0;
   for (auto& texture : texture_data) {
     auto const endpath = texture.getFilePath(dirpath);
     if (!std::filesystem::exists(endpath)) {
       continue;
     }
-    if(auto const res = texture.importDDS(endpath); !res.first){
+    TextureData imported{};
+    if(auto const res = imported.importDDS(endpath, import_options); !res.first){
       return {false, endpath.string() + " failed to load: " + res.second};
     }
+    // Exports that round-trip unchanged shouldn't force a repack
+    if (imported.sameImage(texture)) {
+      ++unchanged_count;
+      continue;
+    }
+    texture.takeImage(std::move(imported));
     ++texture_count;
   }
+  updateSize();
+  has_changes = texture_count > 0;
   if(0 == texture_count) {
+    if (unchanged_count) {
+      return {true, std::to_string(unchanged_count) + " textures match the embedded data"};
+    }
     return {false, "failed to import textures: nothing to import"};
   }
   std::stringstream result_str;
   result_str << "Imported " << texture_count << " textures";
+  if (unchanged_count) {
+    result_str << ", " << unchanged_count << " unchanged";
+  }
   return {true, result_str.str()};
 }
 
@@ -464,10 +724,11 @@ Result NUT::loadDDS(std::filesystem::path const& dirpath)
     if(auto const res = texture.fromJson(nut_data["texture_data"].as_object()[path.stem().string()]); !res.first) {
       return {false, path.string() + " failed to load texture metadata: " + res.second};
     }
-    if(auto const res = texture.importDDS(path); !res.first){
+    if(auto const res = texture.importDDS(path, import_options); !res.first){
       return {false, path.string() + " failed to load: " + res.second};
     }
   }
+  updateSize();
   return {true, "successfully loaded DDS files"};
 }
 
@@ -482,16 +743,37 @@ bool NUT::hasFiles(const std::filesystem::__cxx11::path& path) const {
 
 void NUT::reset() {
   texture_data.clear();
+  texture_arena.clear();
+  has_changes = false;
+  updateSize();
+}
+
+std::vector<TextureData> const& NUT::textures() const {
+  return texture_data;
+}
+
+bool NUT::changed() const {
+  return has_changes;
+}
+
+void NUT::setImportOptions(ImportOptions const& options) {
+  import_options = options;
 }
 
 size_t NUT::size() const
+{
+  return file_size;
+}
+
+// Textures only change on load and import, so the size is counted there
+void NUT::updateSize()
 {
   ByteCounter counter { 16 }; // header size
   for(auto const& section: texture_data) {
       counter.addSize(section.calculateSize());
       counter.pad(0x10);
   }
-  return counter.offset;
+  file_size = counter.offset;
 }
 
 } // namespace file
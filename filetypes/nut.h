@@ -1,8 +1,12 @@
 #pragma once
 
 #include "filetypes/manageable.h"
+#include "utility/image.h"
+#include "utility/payload.h"
 
+#include <array>
 #include <filesystem>
+#include <span>
 #include <vector>
 
 #include <boost/json.hpp>
@@ -10,6 +14,15 @@
 namespace imas {
 namespace file {
 
+class TextureCache;
+
+struct ImportOptions {
+  bool generate_mipmaps = false; // rebuild the whole mipmap chain from the base level of the DDS
+  TextureCache* cache = nullptr; // reuse textures converted earlier from identical DDS files
+};
+
+constexpr int max_mipmap_count = 16;
+
 struct TextureData {
   //	int texture_data_size;		// size including header
   int unknown0;
@@ -29,7 +42,7 @@ struct TextureData {
   int unknown6;
   int unknown7;
 
-  std::vector<int> mipmap_size;
+  std::array<int32_t, max_mipmap_count> mipmap_size{}; // first nMipmap are used when nMipmap > 1
 
   // eXt
   struct {
@@ -46,12 +59,14 @@ struct TextureData {
   }gidx;
 
   // raw data of image
-  std::vector<char> raw_texture;
+  utility::Payload raw_texture; // views the arena of the owning NUT, imported textures own their bytes
 
-  std::filesystem::path const getFilePath(std::filesystem::path const& path) const;
+  std::filesystem::path const getFilePath(std::filesystem::path const& path, std::string const& extension = ".dds") const;
 
-  bool load(std::basic_istream<char> *stream);
-  void write(std::basic_ostream<char> *stream);
+  // 'stream' reads from 'arena', the texture keeps a view of its bytes there
+  bool load(std::basic_istream<char> *stream, std::span<char const> arena);
+  void write(std::vector<char>& output) const;
+  std::span<int32_t const> mipmaps() const;
 
   int16_t headerSize() const;
   int32_t calculateSize() const;
@@ -60,16 +75,35 @@ struct TextureData {
   Result fromJson(boost::json::value const& value);
   //TO DO: Maybe add size validation
   Result exportDDS(std::filesystem::path const& extract_dir_path) const;
-  Result importDDS(std::filesystem::path const& filepath);
+  Result importDDS(std::filesystem::path const& filepath, ImportOptions const& options = {});
+  Result generateMipmaps();
+  void updateMipmapSizes();
+  bool sameImage(TextureData const& other) const;
+  // Moves image data (format, size, mipmaps and pixels) over from 'other', keeping the rest
+  void takeImage(TextureData&& other);
+  // Decodes a single mipmap level into RGBA
+  Result decode(utility::Image& image, int mip_level = 0) const;
+  Result exportPNG(std::filesystem::path const& extract_dir_path, int mip_level = 0) const;
 };
 
 struct NUT : public Manageable {
 public:
+  NUT() = default;
+  // Textures view into texture_arena, copies would point into the original
+  NUT(NUT const&) = delete;
+  NUT& operator=(NUT const&) = delete;
+
   Manageable::Fileapi api() const override;
   Result
   loadDDS(const std::filesystem::path &dirpath); // builds nut from scratch
   bool hasFiles(std::filesystem::path const& path) const;
   void reset();
+  void setImportOptions(ImportOptions const& options);
+  std::vector<TextureData> const& textures() const;
+  // Whether the last inject replaced any texture
+  bool changed() const;
+  // Exports every texture as PNG. Textures with fewer mipmaps fall back to their smallest level.
+  Result exportPNG(std::filesystem::path const& savepath, int mip_level = 0) const;
 
   virtual Result extract(std::filesystem::path const& savepath) const override;
   virtual Result inject(std::filesystem::path const& openpath) override;
@@ -79,7 +113,13 @@ protected:
   Result saveToStream(std::basic_ostream<char> *stream) override;
   size_t size() const override;
 private:
+  void updateSize();
+
   std::vector<TextureData> texture_data;
+  std::vector<char> texture_arena; // payloads of the loaded textures, back to back
+  size_t file_size = 16;
+  ImportOptions import_options;
+  bool has_changes = false;
 
   int unknown0;
   int unknown1;
@@ -3,18 +3,21 @@
 #include <utility/datatools.h>
 #include <utility/streamtools.h>
 
-#include <boost/iostreams/device/array.hpp>
-#include <boost/iostreams/stream.hpp>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 
 namespace {
-constexpr int32_t offset_unknown_header_data = 0x14;
-constexpr int32_t offset_header_cache = 0x30;
 constexpr int32_t offset_sections = 0x70;
 // For some reason scb-file uses different paddings for different sections.
 constexpr char pre_MSG_padding_literal = 0xCD;
 constexpr char post_MSG_padding_literal = 0xCC;
 // constexpr int32_t msg_offset = 148;
 constexpr auto offset_data_size = 0x10;
+constexpr auto data_size_base = 0x20; // the data size doesn't count the first 0x20 bytes
+constexpr auto section_entry_size = 0x10;
+constexpr auto section_count = 7;
+constexpr auto msg_section_index = 2; // CMD, LBL, MSG, ...
 } // namespace
 
 namespace imas {
@@ -30,6 +33,19 @@ Manageable::Fileapi SCB::api() const {
   return api;
 }
 
+std::optional<std::span<char const>> SCB::msgSection(std::span<char const> data) {
+  if (data.size() < offset_sections + section_count * section_entry_size) {
+    return {};
+  }
+  auto const entry = data.data() + offset_sections + msg_section_index * section_entry_size;
+  auto const size = utility::loadValue<int32_t>(entry + 4);
+  auto const offset = utility::loadValue<int32_t>(entry + 8);
+  if (std::memcmp(entry, "MSG", 3) || size < 0 || offset < 0 || uint64_t(offset) + size > data.size()) {
+    return {};
+  }
+  return data.subspan(offset, size);
+}
+
 MSG &SCB::msg_data() { return m_msg_data; }
 
 Result SCB::extract(std::filesystem::path const &savepath) const {
@@ -48,6 +64,14 @@ Result SCB::inject(std::filesystem::path const &openpath) {
   return res;
 }
 
+Result SCB::setStrings(std::vector<std::u16string> strings) {
+  auto const res = m_msg_data.setStrings(std::move(strings));
+  if (res.first) {
+    rebuild();
+  }
+  return res;
+}
+
 #ifdef SCB_RESEARCH
 void SCB::extractSections(const std::filesystem::__cxx11::path& savepath) const
 {
@@ -61,27 +85,69 @@ void SCB::extractSections(const std::filesystem::__cxx11::path& savepath) const
 #endif
 
 Result SCB::openFromStream(std::basic_istream<char> *stream) {
-  stream->seekg(offset_unknown_header_data);
-  stream->read(m_header_cache.data(), m_header_cache.size());
-  stream->seekg(offset_sections);
+  m_source.assign(std::istreambuf_iterator<char>(*stream), {});
+  return parse(m_source);
+}
 
-  for (auto section : m_sections_agg) {
-    stream->read(section->label, sizeof(ScbSection::label));
-    section->size = imas::utility::readLong(stream);
-    section->offset = imas::utility::readLong(stream);
-    stream->ignore(4);
+Result SCB::openFromData(std::span<char const> data) {
+  m_source = {};
+  return parse(data);
+}
+
+// The table is checked in locals, the SCB only takes them once all of it is
+// valid. A failed parse leaves it empty, never viewing a previous file.
+Result SCB::parse(std::span<char const> data) {
+  constexpr auto header_size = offset_sections + section_count * section_entry_size;
+  if (data.size() < header_size) {
+    reset();
+    return {false, "file is too small for an SCB header"};
   }
-  std::ranges::sort(m_sections_agg, std::ranges::less{}, &ScbSection::offset);
-  for (auto section : m_sections_agg) {
-    stream->seekg(section->offset);
-    section->data.resize(section->size);
-    stream->read(section->data.data(), section->size);
+  ScbData sections;
+  auto entry = data.data() + offset_sections;
+  for (auto member : section_table) {
+    auto &section = sections.*member;
+    std::memcpy(section.label, entry, sizeof(ScbSection::label));
+    section.size = utility::loadValue<int32_t>(entry + 4);
+    section.offset = utility::loadValue<int32_t>(entry + 8);
+    entry += section_entry_size;
+  }
+  auto by_offset = section_table;
+  std::ranges::stable_sort(by_offset, std::ranges::less{},
+                           [&](auto member) { return (sections.*member).offset; });
+  // Saving copies everything before MSG as it is and writes the rest at the
+  // section offsets, so sections can't overlap the header or each other
+  if (sections.MSG.offset < header_size) {
+    reset();
+    return {false, "SCB section MSG overlaps the header"};
+  }
+  uint64_t previous_end = 0;
+  for (auto member : by_offset) {
+    auto &section = sections.*member;
+    auto const label = std::string(section.label, 3);
+    if (uint64_t(section.offset) + section.size > data.size()) {
+      reset();
+      return {false, "SCB section " + label + " is out of bounds"};
+    }
+    if (section.offset < previous_end) {
+      reset();
+      return {false, "SCB section " + label + " overlaps another one"};
+    }
+    previous_end = uint64_t(section.offset) + section.size;
+    section.data.view(data.subspan(section.offset, section.size));
+  }
+  if (auto const res = m_msg_data.loadFromData(sections.MSG.data.span()); !res.first) {
+    reset();
+    return {false, "SCB section MSG: " + res.second};
+  }
+  m_sections = std::move(sections);
+  for (size_t i = 0; i < by_offset.size(); ++i) {
+    m_sections_agg[i] = &(m_sections.*by_offset[i]);
   }
-  m_msg_data.loadFromData(m_sections.MSG.data);
+  m_data = data;
 #ifdef SCB_RESEARCH
-  m_lbn_data.loadFromData(m_sections.LBN.data);
-  m_rsn_data.loadFromData(m_sections.RSN.data);
-  m_vcn_data.loadFromData(m_sections.VCN.data);
+  m_lbn_data.loadFromData(m_sections.LBN.data.span());
+  m_rsn_data.loadFromData(m_sections.RSN.data.span());
+  m_vcn_data.loadFromData(m_sections.VCN.data.span());
 #endif
 
   // Testing
@@ -89,71 +155,80 @@ Result SCB::openFromStream(std::basic_istream<char> *stream) {
   return {true, ""};
 }
 
+void SCB::reset() {
+  m_source = {};
+  m_data = {};
+  m_sections = {};
+  m_msg_data.reset();
+}
+
 void SCB::rebuild() {
-  msg_data().saveToData(m_sections.MSG.data);
+  std::vector<char> msg;
+  m_msg_data.write(msg);
+  m_sections.MSG.data.assign(std::move(msg));
   m_sections.MSG.size = 0;
   updateSectionData();
 }
 
+// Sections before MSG keep their place, the ones after it follow the new MSG
 void SCB::updateSectionData() {
-  /*if(std::ranges::all_of(m_sections_agg, [](ScbSection* section){
-      return section->data.size() == section->size;
-  })){
-      return;
-  }*/
-  auto iter = m_sections_agg.begin();
-  (*iter)->size = (*iter)->data.size();
-  auto next = iter + 1;
-  auto const end = m_sections_agg.cend();
-  ByteCounter counter{m_sections_agg.front()->offset};
-  while (next != end) {
-    counter.addSize((*iter)->data.size());
+  auto section = std::ranges::find(m_sections_agg, &m_sections.MSG);
+  (*section)->size = (*section)->data.size();
+  ByteCounter counter{(*section)->offset};
+  for (auto next = section + 1; next != m_sections_agg.end(); section = next++) {
+    counter.addSize((*section)->size);
     counter.pad(0x10);
     (*next)->offset = counter.offset;
-    (*next)->size = (*next)->data.size();
-    iter = next++;
   }
 }
 
 size_t SCB::size() const {
-  ByteCounter counter{
-      static_cast<uint32_t>(offset_sections + m_sections_agg.size() * 0x10)};
-  for (auto section : m_sections_agg) {
-    counter.addSize(section->size);
-    counter.pad(0x10);
+  auto const last = m_sections_agg.back();
+  return padValue(last->offset + last->size, 0x10);
+}
+
+// Everything before MSG is copied from the loaded file in one go. Only the
+// header sizes, MSG and the sections after it are written again.
+void SCB::write(std::vector<char> &buffer) const {
+  auto const file_size = size();
+  buffer.clear();
+  buffer.reserve(file_size);
+  auto const prefix = m_data.first(m_sections.MSG.offset);
+  buffer.insert(buffer.end(), prefix.begin(), prefix.end());
+  utility::storeValue(buffer.data() + offset_data_size, int32_t(file_size - data_size_base));
+  auto entry = buffer.data() + offset_sections;
+  for (auto member : section_table) {
+    utility::storeValue(entry + 4, (m_sections.*member).size);
+    utility::storeValue(entry + 8, (m_sections.*member).offset);
+    entry += section_entry_size;
   }
-  return counter.offset;
+  // MSG itself is padded like the sections before it
+  auto padding = pre_MSG_padding_literal;
+  auto const msg = std::ranges::find(m_sections_agg, &m_sections.MSG);
+  for (auto section : std::ranges::subrange(msg, m_sections_agg.end())) {
+    buffer.resize(section->offset, padding);
+    auto const data = section->data.span();
+    buffer.insert(buffer.end(), data.begin(), data.end());
+    padding = section == &m_sections.MSG ? pre_MSG_padding_literal : post_MSG_padding_literal;
+  }
+  buffer.resize(file_size, padding);
 }
 
-Result SCB::saveToStream(std::basic_ostream<char> *stream) {
-  // Let's fill header
-  stream->write("SCB", 3);
-  utility::padStream(stream, 0, 8);
-  stream->put(0x45);
-  utility::padStream(stream, 0, 3);
-  stream->put(0x45);
-  int32_t const h_size = size() - 0x20;
-  utility::writeLong(stream, h_size);
-  stream->write(m_header_cache.data(), m_header_cache.size());
-  // Writing section header
-  for (auto section : m_sections_agg) {
-    stream->write(section->label, sizeof(ScbSection::label));
-    imas::utility::writeLong(stream, section->size);
-    imas::utility::writeLong(stream, section->offset);
-    imas::utility::padStream(stream, post_MSG_padding_literal, 4);
+Result SCB::saveToBuffer(std::vector<char> &output) {
+  if (m_data.empty()) {
+    return {false, "no SCB is loaded"};
   }
-  // Writing section data
-  bool post_msg = false;
-  for (auto section : m_sections_agg) {
-    stream->write(section->data.data(), section->data.size());
-    imas::utility::evenWriteStream(stream, post_msg ? post_MSG_padding_literal
-                                                    : pre_MSG_padding_literal);
-    if (section == &m_sections.MSG) {
-      post_msg = true;
-    }
+  write(output);
+  return {true, ""};
+}
+
+Result SCB::saveToStream(std::basic_ostream<char> *stream) {
+  if (m_data.empty()) {
+    return {false, "no SCB is loaded"};
   }
-  // Finalizing
-  utility::evenWriteStream(stream, post_MSG_padding_literal);
+  std::vector<char> buffer;
+  write(buffer);
+  stream->write(buffer.data(), buffer.size());
   return {true, ""};
 }
 
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <filetypes/manageable.h>
+#include <utility/payload.h>
 
-#include <vector>
+#include <array>
 #include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
 
 #include "msg.h"
 
@@ -17,7 +21,8 @@ struct ScbSection {
   uint32_t offset = 0;
   //Other modules should ignore size and offset, instead manipulating with 'data';
   char label[4];
-  std::vector<char> data;
+  // Views the loaded file, sections that get rebuilt own their bytes
+  utility::Payload data;
 };
 
 struct ScbData {
@@ -30,11 +35,24 @@ struct ScbData {
   ScbSection RSN;
 };
 
+// Sections are not copied on load: after loadFromData they view the caller's
+// buffer, which has to stay alive and unchanged while the SCB is used.
+// Files and streams are read into a buffer of the SCB's own.
 class SCB : public Manageable {
 public:
+  SCB() = default;
+  SCB(SCB const&) = delete;
+  SCB& operator=(SCB const&) = delete;
+
+  // MSG section of an SCB file, read from the section table alone, for tools
+  // that only need the text
+  static std::optional<std::span<char const>> msgSection(std::span<char const> data);
+
   Fileapi api() const override;
   void rebuild();
   MSG &msg_data();
+  // MSG::setStrings followed by a rebuild
+  Result setStrings(std::vector<std::u16string> strings);
 
   //virtuals
   virtual Result extract(std::filesystem::path const& savepath) const override;
@@ -45,13 +63,25 @@ public:
 #endif
 
 private:
+  Result openFromData(std::span<char const> data) override;
   Result openFromStream(std::basic_istream<char> *stream) override;
+  Result saveToBuffer(std::vector<char> &output) override;
   Result saveToStream(std::basic_ostream<char> *stream) override;
+  Result parse(std::span<char const> data);
+  // Forgets the loaded file
+  void reset();
+  void write(std::vector<char> &output) const;
   void updateSectionData();
   size_t size() const override;
 
-  std::array<char, 0x5C> m_header_cache;
+  std::vector<char> m_source; // file contents when not loaded from memory
+  // In the order of the file's section table
+  static constexpr std::array section_table = {&ScbData::CMD, &ScbData::LBL, &ScbData::MSG, &ScbData::VCN,
+                                               &ScbData::LBN, &ScbData::RSC, &ScbData::RSN};
+
+  std::span<char const> m_data; // the loaded file, empty if loading failed
   ScbData m_sections;
+  // By offset
   std::vector<ScbSection *> m_sections_agg = {
       &m_sections.CMD, &m_sections.LBL, &m_sections.MSG, &m_sections.VCN,
       &m_sections.LBN, &m_sections.RSC, &m_sections.RSN};
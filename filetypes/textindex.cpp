@@ -0,0 +1,229 @@
+#include "textindex.h"
+
+#include "utility/stringtools.h"
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <ranges>
+#include <thread>
+
+namespace {
+constexpr char index_label[4] = {'I', 'T', 'X', '1'};
+constexpr size_t trigram_size = 3;
+
+uint32_t trigramKey(char const *text) {
+  return (uint32_t(uint8_t(text[0])) << 16) | (uint32_t(uint8_t(text[1])) << 8) | uint8_t(text[2]);
+}
+} // namespace
+
+namespace imas {
+namespace file {
+
+Result TextIndex::build(std::vector<ArchiveText> const &archives, unsigned thread_count,
+                        std::filesystem::path const &path) {
+  std::string pool;
+  auto const addText = [&](std::string_view text) {
+    tx::Text const result{uint32_t(pool.size()), uint32_t(text.size())};
+    pool += text;
+    return result;
+  };
+  std::vector<tx::Archive> archive_table;
+  std::vector<tx::File> file_table;
+  std::vector<tx::Text> lines;
+  for (auto const &archive : archives) {
+    archive_table.push_back({addText(archive.name), uint32_t(file_table.size()),
+                             uint32_t(archive.scripts.size())});
+    for (auto const &script : archive.scripts) {
+      file_table.push_back({addText(script.subfile), uint32_t(lines.size()),
+                            uint32_t(script.strings.size())});
+      for (auto const &string : script.strings) {
+        auto const offset = pool.size();
+        utility::appendUtf8FromUtf16(pool, string);
+        lines.push_back({uint32_t(offset), uint32_t(pool.size() - offset)});
+      }
+    }
+  }
+
+  // Every thread takes a contiguous run of lines and sorts its (trigram, line)
+  // pairs; the runs are merged afterwards
+  thread_count = std::clamp<size_t>(thread_count, 1, std::max<size_t>(lines.size(), 1));
+  std::vector<std::vector<uint64_t>> parts(thread_count);
+  {
+    std::vector<std::jthread> workers;
+    for (size_t part = 0; part < thread_count; ++part) {
+      workers.emplace_back([&, part] {
+        auto &pairs = parts[part];
+        auto const end = lines.size() * (part + 1) / thread_count;
+        for (auto line = lines.size() * part / thread_count; line < end; ++line) {
+          auto const text = pool.data() + lines[line].offset;
+          for (size_t i = 0; i + trigram_size <= lines[line].size; ++i) {
+            pairs.push_back(uint64_t(trigramKey(text + i)) << 32 | line);
+          }
+        }
+        std::ranges::sort(pairs);
+        pairs.erase(std::ranges::unique(pairs).begin(), pairs.end());
+      });
+    }
+  }
+  std::vector<tx::Trigram> trigrams;
+  std::vector<uint32_t> postings;
+  using Cursor = std::pair<uint64_t, size_t>; // pair, part
+  std::priority_queue<Cursor, std::vector<Cursor>, std::greater<>> heads;
+  std::vector<size_t> positions(parts.size());
+  for (size_t part = 0; part < parts.size(); ++part) {
+    if (!parts[part].empty()) {
+      heads.emplace(parts[part].front(), part);
+    }
+  }
+  while (!heads.empty()) {
+    auto const [pair, part] = heads.top();
+    heads.pop();
+    auto const key = uint32_t(pair >> 32);
+    if (trigrams.empty() || trigrams.back().key != key) {
+      trigrams.push_back({key, uint32_t(postings.size()), 0});
+    }
+    postings.push_back(uint32_t(pair));
+    ++trigrams.back().posting_count;
+    if (++positions[part] < parts[part].size()) {
+      heads.emplace(parts[part][positions[part]], part);
+    }
+  }
+
+  tx::Header const header{.label = {index_label[0], index_label[1], index_label[2], index_label[3]},
+                          .archive_count = uint32_t(archive_table.size()),
+                          .file_count = uint32_t(file_table.size()),
+                          .line_count = uint32_t(lines.size()),
+                          .trigram_count = uint32_t(trigrams.size()),
+                          .posting_count = uint32_t(postings.size()),
+                          .pool_size = uint32_t(pool.size()),
+                          .reserved = 0};
+  return utility::replaceFile(path, [&](std::ostream &stream) {
+    stream.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    utility::writeTable(stream, archive_table);
+    utility::writeTable(stream, file_table);
+    utility::writeTable(stream, lines);
+    utility::writeTable(stream, trigrams);
+    utility::writeTable(stream, postings);
+    stream.write(pool.data(), pool.size());
+  });
+}
+
+Result TextIndex::open(std::filesystem::path const &path) {
+  close();
+  try {
+    if (std::filesystem::file_size(path) < sizeof(tx::Header)) {
+      return {false, path.string() + " is too small for a text index"};
+    }
+    m_file.open(path.native());
+  } catch (std::exception const &e) {
+    return {false, "failed to open " + path.string() + ": " + e.what()};
+  }
+  tx::Header header;
+  std::memcpy(&header, m_file.data(), sizeof(header));
+  utility::TableReader reader({m_file.data(), m_file.size()}, sizeof(header));
+  auto const archives = reader.next<tx::Archive>(header.archive_count);
+  auto const files = reader.next<tx::File>(header.file_count);
+  auto const lines = reader.next<tx::Text>(header.line_count);
+  auto const trigrams = reader.next<tx::Trigram>(header.trigram_count);
+  auto const postings = reader.next<uint32_t>(header.posting_count);
+  auto const pool = reader.pool(header.pool_size);
+  if (std::memcmp(header.label, index_label, sizeof(index_label)) || !reader.complete()) {
+    m_file.close();
+    return {false, path.string() + " is not a text index"};
+  }
+
+  // Checked once so lookups don't have to
+  auto const textFits = [&](tx::Text const &text) { return utility::textFits(text, pool); };
+  bool const valid =
+      utility::rangesCover(archives, &tx::Archive::first_file, &tx::Archive::file_count, files.size()) &&
+      utility::rangesCover(files, &tx::File::first_line, &tx::File::line_count, lines.size()) &&
+      std::ranges::all_of(archives, [&](tx::Archive const &archive) { return textFits(archive.name); }) &&
+      std::ranges::all_of(files, [&](tx::File const &file) { return textFits(file.name); }) &&
+      std::ranges::all_of(lines, textFits) &&
+      std::ranges::all_of(trigrams, [&](tx::Trigram const &trigram) {
+        return utility::rangeFits(trigram.first_posting, trigram.posting_count, postings.size());
+      }) &&
+      std::ranges::all_of(postings, [&](uint32_t line) { return line < lines.size(); });
+  if (!valid) {
+    m_file.close();
+    return {false, path.string() + " is damaged"};
+  }
+  m_archives = archives;
+  m_files = files;
+  m_lines = lines;
+  m_trigrams = trigrams;
+  m_postings = postings;
+  m_pool = pool;
+  return {true, ""};
+}
+
+void TextIndex::close() {
+  m_file.close();
+  m_archives = {};
+  m_files = {};
+  m_lines = {};
+  m_trigrams = {};
+  m_postings = {};
+  m_pool = {};
+}
+
+TextIndex::Match TextIndex::match(uint32_t line) const {
+  // open() checked that files cover the lines and archives the files, so each
+  // is the last one starting at or before what it holds
+  auto const file = std::ranges::upper_bound(m_files, line, {}, &tx::File::first_line) - 1;
+  auto const file_index = uint32_t(file - m_files.begin());
+  auto const archive = std::ranges::upper_bound(m_archives, file_index, {}, &tx::Archive::first_file) - 1;
+  return {text(archive->name), text(file->name), line - file->first_line, text(m_lines[line])};
+}
+
+std::vector<TextIndex::Match> TextIndex::search(std::string_view phrase, size_t limit) const {
+  std::vector<Match> matches;
+  if (0 == limit) {
+    return matches;
+  }
+  auto const check = [&](uint32_t line) {
+    if (text(m_lines[line]).find(phrase) != std::string_view::npos) {
+      matches.push_back(match(line));
+    }
+    return matches.size() < limit;
+  };
+  // Too short to have a trigram, every line is a candidate
+  if (phrase.size() < trigram_size) {
+    for (uint32_t line = 0; line < m_lines.size() && check(line); ++line) {
+    }
+    return matches;
+  }
+
+  std::vector<std::span<uint32_t const>> lists;
+  for (size_t i = 0; i + trigram_size <= phrase.size(); ++i) {
+    auto const key = trigramKey(phrase.data() + i);
+    auto const trigram = std::ranges::lower_bound(m_trigrams, key, {}, &tx::Trigram::key);
+    if (trigram == m_trigrams.end() || trigram->key != key) {
+      return matches;
+    }
+    lists.push_back(m_postings.subspan(trigram->first_posting, trigram->posting_count));
+  }
+  // Intersect starting with the rarest trigram, so the candidates shrink fast
+  std::ranges::sort(lists, {}, &std::span<uint32_t const>::size);
+  std::vector<uint32_t> candidates(lists.front().begin(), lists.front().end());
+  std::vector<uint32_t> next;
+  for (auto const &list : lists | std::views::drop(1)) {
+    if (candidates.empty()) {
+      break;
+    }
+    next.clear();
+    std::ranges::set_intersection(candidates, list, std::back_inserter(next));
+    candidates.swap(next);
+  }
+  // Trigrams only say the parts are there, not that they are in order
+  for (auto const line : candidates) {
+    if (!check(line)) {
+      break;
+    }
+  }
+  return matches;
+}
+
+} // namespace file
+} // namespace imas
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "filetypes/gametext.h"
+#include "utility/mappedtables.h"
+#include "utility/result.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+// Substring search over every script line of the game. Lines are indexed by
+// the byte trigrams of their UTF-8 text; a query intersects the posting lists
+// of its trigrams and checks the few remaining lines directly. The file is a
+// header followed by fixed-size tables and a UTF-8 pool, used in place from a
+// memory mapping:
+//   archives  name and range of files, sorted by name
+//   files     scripts, by archive, with their range of lines
+//   lines     text of every line, by file and index
+//   trigrams  sorted keys with their range of postings
+//   postings  ascending line numbers, by trigram
+//   pool      text of names and lines
+
+namespace imas {
+namespace file {
+
+namespace tx {
+struct Header {
+  char label[4];
+  uint32_t archive_count;
+  uint32_t file_count;
+  uint32_t line_count;
+  uint32_t trigram_count;
+  uint32_t posting_count;
+  uint32_t pool_size;
+  uint32_t reserved;
+};
+
+using Text = utility::PoolText;
+
+struct Archive {
+  Text name;
+  uint32_t first_file;
+  uint32_t file_count;
+};
+
+struct File {
+  Text name;
+  uint32_t first_line;
+  uint32_t line_count;
+};
+
+struct Trigram {
+  uint32_t key;
+  uint32_t first_posting;
+  uint32_t posting_count;
+};
+} // namespace tx
+
+class TextIndex {
+public:
+  struct Match {
+    std::string_view archive;
+    std::string_view subfile;
+    uint32_t index;
+    std::string_view text;
+  };
+
+  // Archives are expected in the order listArchives gives them
+  static Result build(std::vector<ArchiveText> const &archives, unsigned thread_count,
+                      std::filesystem::path const &path);
+
+  Result open(std::filesystem::path const &path);
+  void close();
+  // Lines containing 'phrase' (byte exact), in game order
+  std::vector<Match> search(std::string_view phrase,
+                            size_t limit = std::numeric_limits<size_t>::max()) const;
+  size_t lineCount() const { return m_lines.size(); }
+
+private:
+  std::string_view text(tx::Text const &text) const { return m_pool.substr(text.offset, text.size); }
+  Match match(uint32_t line) const;
+
+  boost::iostreams::mapped_file_source m_file;
+  std::span<tx::Archive const> m_archives;
+  std::span<tx::File const> m_files;
+  std::span<tx::Text const> m_lines;
+  std::span<tx::Trigram const> m_trigrams;
+  std::span<uint32_t const> m_postings;
+  std::string_view m_pool;
+};
+
+} // namespace file
+} // namespace imas
@@ -0,0 +1,130 @@
+#include "texturecache.h"
+
+#include "utility/streamtools.h"
+
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <random>
+
+namespace {
+constexpr auto cache_label = "NTC0";
+constexpr auto cache_extension = ".ntc";
+constexpr size_t entry_header_size = 4 + 5 * sizeof(int32_t);
+// Far beyond anything the game uses, keeps damaged entries from asking for huge buffers
+constexpr int32_t max_dimension = 16384;
+constexpr int32_t max_mipmaps = 16;
+} // namespace
+
+namespace imas {
+namespace file {
+
+TextureCache::TextureCache(std::filesystem::path const& directory)
+    : m_directory(directory) {
+  std::error_code ec;
+  std::filesystem::create_directories(m_directory, ec);
+  if (ec) {
+    // Fall back to a memory-only cache
+    m_directory.clear();
+  }
+}
+
+std::shared_ptr<CachedTexture const> TextureCache::find(uint64_t key) {
+  {
+    std::shared_lock lock(m_mutex);
+    if (auto const it = m_entries.find(key); it != m_entries.end()) {
+      return it->second;
+    }
+  }
+  auto entry = loadEntry(key);
+  if (entry) {
+    std::unique_lock lock(m_mutex);
+    m_entries.emplace(key, entry);
+  }
+  return entry;
+}
+
+void TextureCache::insert(uint64_t key, CachedTexture texture) {
+  auto entry = std::make_shared<CachedTexture const>(std::move(texture));
+  saveEntry(key, *entry);
+  std::unique_lock lock(m_mutex);
+  m_entries.insert_or_assign(key, std::move(entry));
+}
+
+std::filesystem::path TextureCache::entryPath(uint64_t key) const {
+  return m_directory / std::format("{:016x}{}", key, cache_extension);
+}
+
+std::shared_ptr<CachedTexture const> TextureCache::loadEntry(uint64_t key) const {
+  if (m_directory.empty()) {
+    return {};
+  }
+  auto const path = entryPath(key);
+  std::error_code ec;
+  auto const file_size = std::filesystem::file_size(path, ec);
+  if (ec || file_size < entry_header_size) {
+    return {};
+  }
+  std::ifstream stream(path, std::ios_base::binary);
+  if (!stream.is_open()) {
+    return {};
+  }
+  std::string label;
+  label.resize(4);
+  stream.read(label.data(), 4);
+  if (cache_label != label) {
+    return {};
+  }
+  // Entries are only a shortcut, anything odd is treated as a miss
+  CachedTexture texture;
+  texture.pixel_type = utility::readLong(&stream);
+  texture.width = utility::readLong(&stream);
+  texture.height = utility::readLong(&stream);
+  texture.nMipmap = utility::readLong(&stream);
+  auto const size = utility::readLong(&stream);
+  if (!stream || texture.width < 1 || texture.width > max_dimension || texture.height < 1 ||
+      texture.height > max_dimension || texture.nMipmap < 1 || texture.nMipmap > max_mipmaps ||
+      size < 0 || uint64_t(size) != file_size - entry_header_size) {
+    return {};
+  }
+  texture.raw_texture.resize(size);
+  stream.read(texture.raw_texture.data(), texture.raw_texture.size());
+  if (!stream) {
+    return {};
+  }
+  return std::make_shared<CachedTexture const>(std::move(texture));
+}
+
+void TextureCache::saveEntry(uint64_t key, CachedTexture const& texture) const {
+  if (m_directory.empty()) {
+    return;
+  }
+  // Write under a random name and rename, so other threads or processes never
+  // see a half-written entry
+  std::random_device random;
+  auto const suffix = uint64_t(random()) << 32 | random();
+  auto const final_path = entryPath(key);
+  auto temp_path = final_path;
+  temp_path += std::format(".{:016x}.tmp", suffix);
+  {
+    std::ofstream stream(temp_path, std::ios_base::binary);
+    if (!stream.is_open()) {
+      return;
+    }
+    stream.write(cache_label, 4);
+    utility::writeLong(&stream, texture.pixel_type);
+    utility::writeLong(&stream, texture.width);
+    utility::writeLong(&stream, texture.height);
+    utility::writeLong(&stream, texture.nMipmap);
+    utility::writeLong(&stream, texture.raw_texture.size());
+    stream.write(texture.raw_texture.data(), texture.raw_texture.size());
+  }
+  std::error_code ec;
+  std::filesystem::rename(temp_path, final_path, ec);
+  if (ec) {
+    std::filesystem::remove(temp_path, ec);
+  }
+}
+
+} // namespace file
+} // namespace imas
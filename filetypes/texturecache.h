@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace imas {
+namespace file {
+
+// Already converted texture, ready to be put into a NUT
+struct CachedTexture {
+  int pixel_type;
+  int width;
+  int height;
+  int nMipmap;
+  std::vector<char> raw_texture; // byteswapped, as NUT keeps it
+};
+
+// Remembers DDS imports by the hash of the source file and the import options,
+// so the same image gets converted only once. Safe to share between threads.
+// With a directory set, entries are also kept on disk and survive between runs.
+// Disk entries are checked for sane sizes, but the directory should belong to
+// the user (the patch folder, not a shared temp folder).
+class TextureCache {
+public:
+  TextureCache() = default;
+  explicit TextureCache(std::filesystem::path const& directory);
+
+  std::shared_ptr<CachedTexture const> find(uint64_t key);
+  void insert(uint64_t key, CachedTexture texture);
+
+private:
+  std::filesystem::path entryPath(uint64_t key) const;
+  std::shared_ptr<CachedTexture const> loadEntry(uint64_t key) const;
+  void saveEntry(uint64_t key, CachedTexture const& texture) const;
+
+  std::shared_mutex m_mutex;
+  std::unordered_map<uint64_t, std::shared_ptr<CachedTexture const>> m_entries;
+  std::filesystem::path m_directory;
+};
+
+} // namespace file
+} // namespace imas
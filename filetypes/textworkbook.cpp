@@ -0,0 +1,139 @@
+#include "textworkbook.h"
+
+#include "utility/stringtools.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <format>
+
+namespace {
+constexpr auto key_separator = '|';
+constexpr auto key_column = 0;
+constexpr auto text_column = 1;
+constexpr auto translation_column = 2;
+constexpr auto shard_extension = ".xlsx";
+constexpr size_t max_strings = 0x8000; // MSG keeps a 16-bit count
+constexpr std::array<std::string_view, 5> header_row = {"key", "text", "translated", "note", "issues"};
+} // namespace
+
+namespace imas {
+namespace file {
+
+TextWorkbookWriter::TextWorkbookWriter(std::filesystem::path directory, std::string name,
+                                       size_t rows_per_shard)
+    : m_directory(std::move(directory)), m_name(std::move(name)),
+      m_rows_per_shard(std::max<size_t>(rows_per_shard, 1)) {
+  m_workbook.addRow(header_row);
+}
+
+Result TextWorkbookWriter::add(std::string_view archive, std::string_view subfile, MSG const &msg) {
+  auto const &entries = msg.entries();
+  if (m_rows > 0 && m_rows + entries.size() > m_rows_per_shard) {
+    if (auto const res = saveShard(); !res.first) {
+      return res;
+    }
+  }
+  std::string key;
+  std::string text;
+  std::array<std::string_view, text_column + 1> row;
+  for (size_t index = 0; index < entries.size(); ++index) {
+    key = std::format("{}{}{}{}{}", archive, key_separator, subfile, key_separator, index);
+    text.clear();
+    utility::appendUtf8FromUtf16(text, entries[index].data);
+    row[key_column] = key;
+    row[text_column] = text;
+    m_workbook.addRow(row);
+  }
+  m_rows += entries.size();
+  return {true, ""};
+}
+
+Result TextWorkbookWriter::finish() {
+  return m_rows > 0 ? saveShard() : Result{true, ""};
+}
+
+Result TextWorkbookWriter::saveShard() {
+  auto path = m_directory / std::format("{}_{:03}{}", m_name, m_shards.size() + 1, shard_extension);
+  if (auto const res = m_workbook.save(path); !res.first) {
+    return res;
+  }
+  m_shards.push_back(std::move(path));
+  m_rows = 0;
+  m_workbook.addRow(header_row);
+  return {true, ""};
+}
+
+Result TextWorkbookReader::load(std::filesystem::path const &directory, std::string_view name) {
+  m_files.clear();
+  std::vector<std::filesystem::path> shards;
+  auto const prefix = std::string(name) + '_';
+  std::error_code ec;
+  for (auto const &entry : std::filesystem::directory_iterator(directory, ec)) {
+    auto const filename = entry.path().filename().string();
+    if (entry.is_regular_file() && filename.starts_with(prefix) && filename.ends_with(shard_extension)) {
+      shards.push_back(entry.path());
+    }
+  }
+  if (shards.empty()) {
+    return {false, std::format("no {}*{} workbooks in {}", prefix, shard_extension, directory.string())};
+  }
+  std::ranges::sort(shards);
+
+  constexpr int columns[] = {key_column, translation_column};
+  for (auto const &shard : shards) {
+    utility::XlsxReader workbook;
+    if (auto const res = workbook.open(shard); !res.first) {
+      return res;
+    }
+    // The key comes first in its row, the translation is routed by it
+    std::u16string *target = nullptr;
+    int key_row = 0;
+    std::string error;
+    auto const res = workbook.readColumns(columns, [&](int row, int column, std::string_view text) {
+      // Row 1 holds the column names
+      if (row < 2 || !error.empty()) {
+        return;
+      }
+      if (translation_column == column) {
+        if (row == key_row) {
+          target->clear();
+          utility::appendUtf16FromUtf8(*target, text);
+        }
+        return;
+      }
+      auto const separator = text.rfind(key_separator);
+      size_t index = 0;
+      auto const [end, status] =
+          std::from_chars(text.data() + separator + 1, text.data() + text.size(), index);
+      if (std::string_view::npos == separator || 0 == separator ||
+          text.find(key_separator) == separator || status != std::errc{} ||
+          end != text.data() + text.size() || index >= max_strings) {
+        error = std::format("{}: broken key \"{}\" in row {}", shard.string(), text, row);
+        return;
+      }
+      auto &strings = m_files[std::string(text.substr(0, separator))];
+      if (strings.size() <= index) {
+        strings.resize(index + 1);
+      }
+      target = &strings[index];
+      key_row = row;
+    });
+    if (!res.first) {
+      return {false, shard.string() + ": " + res.second};
+    }
+    if (!error.empty()) {
+      return {false, error};
+    }
+  }
+  return {true, ""};
+}
+
+std::vector<std::u16string> const *TextWorkbookReader::find(std::string_view archive,
+                                                            std::string_view subfile) const {
+  auto const iter = m_files.find(std::format("{}{}{}", archive, key_separator, subfile));
+  return iter != m_files.end() ? &iter->second : nullptr;
+}
+
+} // namespace file
+} // namespace imas
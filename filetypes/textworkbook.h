@@ -0,0 +1,58 @@
+#pragma once
+
+#include "filetypes/msg.h"
+#include "utility/result.h"
+#include "utility/xlsx.h"
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Strings of many MSG files in a few shared workbooks instead of one workbook
+// per file. Rows keep the single file layout (text in B, translation in C),
+// column A holds the key "<archive>|<subfile>|<index>" that routes the row
+// back on import. Shards are named "<name>_001.xlsx", "<name>_002.xlsx", ...
+
+namespace imas {
+namespace file {
+
+class TextWorkbookWriter {
+public:
+  // A file's strings are never split, so a shard can exceed 'rows_per_shard'
+  // by the size of its last file
+  TextWorkbookWriter(std::filesystem::path directory, std::string name, size_t rows_per_shard);
+
+  Result add(std::string_view archive, std::string_view subfile, MSG const &msg);
+  // Saves the last shard
+  Result finish();
+  std::vector<std::filesystem::path> const &shards() const { return m_shards; }
+
+private:
+  Result saveShard();
+
+  std::filesystem::path m_directory;
+  std::string m_name;
+  size_t m_rows_per_shard;
+  size_t m_rows = 0;
+  utility::XlsxWriter m_workbook;
+  std::vector<std::filesystem::path> m_shards;
+};
+
+class TextWorkbookReader {
+public:
+  // Reads the translation column of all shards in 'directory'
+  Result load(std::filesystem::path const &directory, std::string_view name);
+  // Strings for one file by index, nullptr if the workbooks have no rows for it.
+  // Rows without a translation are empty strings.
+  std::vector<std::u16string> const *find(std::string_view archive, std::string_view subfile) const;
+  size_t fileCount() const { return m_files.size(); }
+
+private:
+  // "<archive>|<subfile>"
+  std::map<std::string, std::vector<std::u16string>, std::less<>> m_files;
+};
+
+} // namespace file
+} // namespace imas
@@ -0,0 +1,301 @@
+#include "translationmemory.h"
+
+#include "utility/hash.h"
+#include "utility/stringtools.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace {
+constexpr char memory_label[4] = {'I', 'T', 'M', '1'};
+
+uint64_t textHash(std::string_view text) { return imas::utility::hash64(text); }
+} // namespace
+
+namespace imas {
+namespace file {
+
+Result TranslationMemory::open(std::filesystem::path const &path) {
+  close();
+  try {
+    if (std::filesystem::file_size(path) < sizeof(tm::Header)) {
+      return {false, path.string() + " is too small for a translation memory"};
+    }
+    m_file.open(path.native());
+  } catch (std::exception const &e) {
+    return {false, "failed to open " + path.string() + ": " + e.what()};
+  }
+  tm::Header header;
+  std::memcpy(&header, m_file.data(), sizeof(header));
+  // Every table keeps 8-byte alignment up to 'strings', so they are used in place
+  utility::TableReader reader({m_file.data(), m_file.size()}, sizeof(header));
+  auto const archives = reader.next<tm::Archive>(header.archive_count);
+  auto const sources = reader.next<tm::Source>(header.source_count);
+  auto const files = reader.next<tm::File>(header.file_count);
+  auto const occurrences = reader.next<tm::Occurrence>(header.string_count);
+  auto const strings = reader.next<uint32_t>(header.string_count);
+  auto const pool = reader.pool(header.pool_size);
+  if (std::memcmp(header.label, memory_label, sizeof(memory_label)) || !reader.complete()) {
+    m_file.close();
+    return {false, path.string() + " is not a translation memory"};
+  }
+
+  // Everything indexes something else, check it once so lookups don't have to
+  auto const textFits = [&](tm::Text const &text) { return utility::textFits(text, pool); };
+  bool const valid =
+      utility::rangesCover(archives, &tm::Archive::first_file, &tm::Archive::file_count, files.size()) &&
+      utility::rangesCover(files, &tm::File::first_string, &tm::File::string_count, strings.size()) &&
+      std::ranges::all_of(archives, [&](tm::Archive const &archive) { return textFits(archive.name); }) &&
+      std::ranges::all_of(files, [&](tm::File const &file) { return textFits(file.name); }) &&
+      std::ranges::all_of(sources, [&](tm::Source const &source) {
+        return textFits(source.text) && textFits(source.translation) &&
+               utility::rangeFits(source.first_occurrence, source.occurrence_count, occurrences.size());
+      }) &&
+      std::ranges::all_of(occurrences, [&](tm::Occurrence const &occurrence) {
+        return occurrence.file < files.size() && occurrence.index < files[occurrence.file].string_count;
+      }) &&
+      std::ranges::all_of(strings, [&](uint32_t source) { return source < sources.size(); });
+  if (!valid) {
+    m_file.close();
+    return {false, path.string() + " is damaged"};
+  }
+  m_archives = archives;
+  m_sources = sources;
+  m_files = files;
+  m_occurrences = occurrences;
+  m_strings = strings;
+  m_pool = pool;
+  return {true, ""};
+}
+
+void TranslationMemory::close() {
+  m_file.close();
+  m_archives = {};
+  m_sources = {};
+  m_files = {};
+  m_occurrences = {};
+  m_strings = {};
+  m_pool = {};
+}
+
+std::optional<uint32_t> TranslationMemory::find(std::string_view text) const {
+  auto const range = std::ranges::equal_range(m_sources, textHash(text), {}, &tm::Source::hash);
+  for (auto const &source : range) {
+    if (this->text(source.text) == text) {
+      return uint32_t(&source - m_sources.data());
+    }
+  }
+  return {};
+}
+
+std::string_view TranslationMemory::source(uint32_t id) const { return text(m_sources[id].text); }
+
+std::string_view TranslationMemory::translation(uint32_t id) const {
+  return text(m_sources[id].translation);
+}
+
+std::string_view TranslationMemory::translate(std::string_view text) const {
+  auto const id = find(text);
+  return id ? translation(*id) : std::string_view{};
+}
+
+std::vector<TranslationMemory::Location> TranslationMemory::occurrences(uint32_t id) const {
+  auto const &source = m_sources[id];
+  std::vector<Location> locations;
+  locations.reserve(source.occurrence_count);
+  for (auto const &occurrence : m_occurrences.subspan(source.first_occurrence, source.occurrence_count)) {
+    // open() checked that archives cover the files, so this is the last one starting at or before it
+    auto const archive = std::ranges::upper_bound(m_archives, occurrence.file, {}, &tm::Archive::first_file) - 1;
+    locations.push_back({text(archive->name), text(m_files[occurrence.file].name), occurrence.index});
+  }
+  return locations;
+}
+
+std::optional<uint32_t> TranslationMemory::findArchive(std::string_view name, uint64_t stamp) const {
+  auto const iter = std::ranges::lower_bound(m_archives, name, {},
+                                             [&](tm::Archive const &archive) { return text(archive.name); });
+  if (iter == m_archives.end() || text(iter->name) != name || iter->stamp != stamp) {
+    return {};
+  }
+  return uint32_t(iter - m_archives.begin());
+}
+
+std::span<tm::File const> TranslationMemory::files(uint32_t archive) const {
+  return m_files.subspan(m_archives[archive].first_file, m_archives[archive].file_count);
+}
+
+std::string_view TranslationMemory::fileString(tm::File const &file, uint32_t index) const {
+  return source(m_strings[file.first_string + index]);
+}
+
+TranslationMemoryBuilder::Archive &TranslationMemoryBuilder::archive(std::string_view name,
+                                                                     uint64_t stamp) {
+  if (m_archives.empty() || m_archives.back().name != name) {
+    m_archives.push_back({.name = std::string(name), .stamp = stamp, .scripts = {}});
+  }
+  return m_archives.back();
+}
+
+void TranslationMemoryBuilder::addArchive(std::string_view archive, uint64_t stamp) {
+  this->archive(archive, stamp);
+}
+
+void TranslationMemoryBuilder::addScript(std::string_view archive, uint64_t stamp,
+                                         std::string subfile, std::vector<std::string> strings) {
+  this->archive(archive, stamp).scripts.push_back({std::move(subfile), std::move(strings)});
+}
+
+bool TranslationMemoryBuilder::reuseArchive(TranslationMemory const &previous,
+                                            std::string_view archive, uint64_t stamp) {
+  auto const index = previous.findArchive(archive, stamp);
+  if (!index) {
+    return false;
+  }
+  auto &target = this->archive(archive, stamp);
+  for (auto const &file : previous.files(*index)) {
+    auto &script = target.scripts.emplace_back(std::string(previous.fileName(file)));
+    script.strings.reserve(file.string_count);
+    for (uint32_t i = 0; i < file.string_count; ++i) {
+      script.strings.emplace_back(previous.fileString(file, i));
+    }
+  }
+  return true;
+}
+
+void TranslationMemoryBuilder::addTranslation(std::string_view source, std::string_view translation) {
+  if (auto const iter = m_translations.find(source); iter != m_translations.end()) {
+    iter->second = translation;
+  } else {
+    m_translations.emplace(source, translation);
+  }
+}
+
+void TranslationMemoryBuilder::addTranslations(
+    std::function<std::vector<std::u16string> const *(std::string_view archive,
+                                                      std::string_view subfile)> const &lookup) {
+  std::string translation;
+  for (auto const &archive : m_archives) {
+    for (auto const &script : archive.scripts) {
+      auto const translations = lookup(archive.name, script.subfile);
+      if (!translations) {
+        continue;
+      }
+      for (size_t i = 0; i < std::min(translations->size(), script.strings.size()); ++i) {
+        if (!(*translations)[i].empty()) {
+          translation.clear();
+          utility::appendUtf8FromUtf16(translation, (*translations)[i]);
+          addTranslation(script.strings[i], translation);
+        }
+      }
+    }
+  }
+}
+
+Result TranslationMemoryBuilder::save(std::filesystem::path const &path) const {
+  std::vector<Archive const *> archives;
+  for (auto const &archive : m_archives) {
+    archives.push_back(&archive);
+  }
+  std::ranges::sort(archives, {}, &Archive::name);
+
+  // Distinct strings in order of appearance, then sorted for lookups
+  std::unordered_map<std::string_view, uint32_t> ids;
+  std::vector<std::string_view> texts;
+  std::vector<uint32_t> string_ids;
+  for (auto const archive : archives) {
+    for (auto const &script : archive->scripts) {
+      for (auto const &string : script.strings) {
+        auto const [iter, added] = ids.try_emplace(string, texts.size());
+        if (added) {
+          texts.push_back(string);
+        }
+        string_ids.push_back(iter->second);
+      }
+    }
+  }
+  std::vector<uint64_t> hashes(texts.size());
+  std::ranges::transform(texts, hashes.begin(), textHash);
+  std::vector<uint32_t> order(texts.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::ranges::sort(order, [&](uint32_t a, uint32_t b) {
+    return hashes[a] != hashes[b] ? hashes[a] < hashes[b] : texts[a] < texts[b];
+  });
+  std::vector<uint32_t> rank(texts.size());
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    rank[order[i]] = i;
+  }
+
+  std::string pool;
+  auto const addText = [&](std::string_view text) {
+    tm::Text const result{uint32_t(pool.size()), uint32_t(text.size())};
+    pool += text;
+    return result;
+  };
+
+  std::vector<tm::Archive> archive_table;
+  std::vector<tm::File> file_table;
+  std::vector<uint32_t> strings;
+  strings.reserve(string_ids.size());
+  std::vector<uint32_t> occurrence_counts(texts.size());
+  for (auto const archive : archives) {
+    archive_table.push_back({.stamp = archive->stamp,
+                             .name = addText(archive->name),
+                             .first_file = uint32_t(file_table.size()),
+                             .file_count = uint32_t(archive->scripts.size())});
+    for (auto const &script : archive->scripts) {
+      file_table.push_back({.name = addText(script.subfile),
+                            .first_string = uint32_t(strings.size()),
+                            .string_count = uint32_t(script.strings.size())});
+      for (size_t i = 0; i < script.strings.size(); ++i) {
+        auto const id = rank[string_ids[strings.size()]];
+        ++occurrence_counts[id];
+        strings.push_back(id);
+      }
+    }
+  }
+
+  std::vector<tm::Source> source_table(texts.size());
+  uint32_t first_occurrence = 0;
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    auto const text = texts[order[i]];
+    auto &source = source_table[i];
+    source.hash = hashes[order[i]];
+    source.text = addText(text);
+    auto const translation = m_translations.find(text);
+    source.translation = addText(translation != m_translations.end() ? translation->second : "");
+    source.first_occurrence = first_occurrence;
+    source.occurrence_count = occurrence_counts[i];
+    first_occurrence += occurrence_counts[i];
+  }
+  // Counting sort of the uses by source
+  std::vector<tm::Occurrence> occurrences(strings.size());
+  for (uint32_t file = 0; file < file_table.size(); ++file) {
+    for (uint32_t index = 0; index < file_table[file].string_count; ++index) {
+      auto &source = source_table[strings[file_table[file].first_string + index]];
+      occurrences[source.first_occurrence++] = {file, index};
+    }
+  }
+  for (auto &source : source_table) {
+    source.first_occurrence -= source.occurrence_count;
+  }
+
+  tm::Header const header{.label = {memory_label[0], memory_label[1], memory_label[2], memory_label[3]},
+                          .archive_count = uint32_t(archive_table.size()),
+                          .file_count = uint32_t(file_table.size()),
+                          .source_count = uint32_t(source_table.size()),
+                          .string_count = uint32_t(strings.size()),
+                          .pool_size = uint32_t(pool.size())};
+  return utility::replaceFile(path, [&](std::ostream &stream) {
+    stream.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    utility::writeTable(stream, archive_table);
+    utility::writeTable(stream, source_table);
+    utility::writeTable(stream, file_table);
+    utility::writeTable(stream, occurrences);
+    utility::writeTable(stream, strings);
+    stream.write(pool.data(), pool.size());
+  });
+}
+
+} // namespace file
+} // namespace imas
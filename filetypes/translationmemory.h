@@ -0,0 +1,164 @@
+#pragma once
+
+#include "utility/mappedtables.h"
+#include "utility/result.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+// Translation memory: every distinct MSG string of the game, where it is used
+// and its translation, if one is known. The file is a header followed by
+// fixed-size tables and a UTF-8 string pool, and is used straight from a
+// memory mapping:
+//   archives     name, stamp and range of files, sorted by name
+//   files        scripts, by archive, with their range in 'strings'
+//   sources      distinct strings, sorted by hash, with their translation
+//                and their range in 'occurrences'
+//   occurrences  file and index of every use of a source, by source
+//   strings      source of every string of every file, by file and index
+//   pool         text of names, sources and translations
+// Archives are stamped, so a rebuild only rereads the archives that changed.
+
+namespace imas {
+namespace file {
+
+namespace tm {
+struct Header {
+  char label[4];
+  uint32_t archive_count;
+  uint32_t file_count;
+  uint32_t source_count;
+  uint32_t string_count;
+  uint32_t pool_size;
+};
+
+using Text = utility::PoolText;
+
+struct Archive {
+  uint64_t stamp;
+  Text name;
+  uint32_t first_file;
+  uint32_t file_count;
+};
+
+struct File {
+  Text name;
+  uint32_t first_string;
+  uint32_t string_count;
+};
+
+struct Source {
+  uint64_t hash;
+  Text text;
+  Text translation;
+  uint32_t first_occurrence;
+  uint32_t occurrence_count;
+};
+
+struct Occurrence {
+  uint32_t file;
+  uint32_t index;
+};
+} // namespace tm
+
+class TranslationMemory {
+public:
+  struct Location {
+    std::string_view archive;
+    std::string_view subfile;
+    uint32_t index;
+  };
+
+  Result open(std::filesystem::path const &path);
+  bool isOpen() const { return m_file.is_open(); }
+  void close();
+
+  // Source id of 'text', nothing if the game doesn't use it
+  std::optional<uint32_t> find(std::string_view text) const;
+  std::string_view source(uint32_t id) const;
+  // Empty if there is none
+  std::string_view translation(uint32_t id) const;
+  std::string_view translate(std::string_view text) const;
+  std::vector<Location> occurrences(uint32_t id) const;
+  size_t sourceCount() const { return m_sources.size(); }
+  size_t stringCount() const { return m_strings.size(); }
+
+  // For rebuilds: the archive's index, if it is stored with 'stamp'
+  std::optional<uint32_t> findArchive(std::string_view name, uint64_t stamp) const;
+  // Subfiles of an archive and their strings
+  std::span<tm::File const> files(uint32_t archive) const;
+  std::string_view fileName(tm::File const &file) const { return text(file.name); }
+  std::string_view fileString(tm::File const &file, uint32_t index) const;
+  // Every source that has a translation, to carry them over
+  template <class Callback>
+  void forEachTranslation(Callback &&callback) const {
+    for (auto const &source : m_sources) {
+      if (source.translation.size > 0) {
+        callback(text(source.text), text(source.translation));
+      }
+    }
+  }
+
+private:
+  std::string_view text(tm::Text const &text) const { return m_pool.substr(text.offset, text.size); }
+
+  boost::iostreams::mapped_file_source m_file;
+  std::span<tm::Archive const> m_archives;
+  std::span<tm::File const> m_files;
+  std::span<tm::Source const> m_sources;
+  std::span<tm::Occurrence const> m_occurrences;
+  std::span<uint32_t const> m_strings;
+  std::string_view m_pool;
+};
+
+// Collects scripts and translations and writes a TranslationMemory file
+class TranslationMemoryBuilder {
+public:
+  void addScript(std::string_view archive, uint64_t stamp, std::string subfile,
+                 std::vector<std::string> strings);
+  // An archive without scripts is still recorded, so it isn't reread next time
+  void addArchive(std::string_view archive, uint64_t stamp);
+  // Copies the scripts of an archive from a previous build, if it was
+  // stored there with the same stamp
+  bool reuseArchive(TranslationMemory const &previous, std::string_view archive, uint64_t stamp);
+  // Later calls override earlier ones for the same source
+  void addTranslation(std::string_view source, std::string_view translation);
+  // Takes translated lines by location, 'lookup' returns the translations of
+  // a script by index or nullptr. Empty lines are skipped.
+  void addTranslations(std::function<std::vector<std::u16string> const *(
+                           std::string_view archive, std::string_view subfile)> const &lookup);
+  Result save(std::filesystem::path const &path) const;
+
+private:
+  struct Script {
+    std::string subfile;
+    std::vector<std::string> strings;
+  };
+  struct Archive {
+    std::string name;
+    uint64_t stamp;
+    std::vector<Script> scripts;
+  };
+
+  Archive &archive(std::string_view name, uint64_t stamp);
+
+  struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view text) const { return std::hash<std::string_view>{}(text); }
+  };
+
+  std::vector<Archive> m_archives;
+  std::unordered_map<std::string, std::string, StringHash, std::equal_to<>> m_translations;
+};
+
+} // namespace file
+} // namespace imas
@@ -0,0 +1,206 @@
+#include "utility/stringtools.h"
+#include "utility/xlsx.h"
+#include "utility/zip.h"
+
+#include <OpenXLSX.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+constexpr auto help_text =
+    "Benchmarks for the shared utility code\n"
+    "Transcoding throughput on a generated mixed ASCII/Japanese corpus:\n"
+    "imasbench transcode\n"
+    "Transcoding throughput on the UTF-8 text of a file:\n"
+    "imasbench transcode <filename>\n"
+    "MSG workbook export, native writer against OpenXLSX, after a check of the reader:\n"
+    "imasbench xlsx [file count] [strings per file]\n";
+
+namespace {
+using bench_clock = std::chrono::steady_clock;
+
+constexpr auto corpus_size = 16 << 20;
+constexpr auto min_duration = std::chrono::milliseconds(500);
+
+// Game text is mostly Japanese with ASCII markup and names mixed in
+std::string generateCorpus() {
+  constexpr std::string_view lines[] = {
+      "<name>P</name>\n",
+      "\xE3\x83\x97\xE3\x83\xAD\xE3\x83\x87\xE3\x83\xA5\xE3\x83\xBC\xE3\x82\xB5\xE3\x83\xBC\xE3\x81\x95\xE3\x82\x93\xE3\x80\x81\xE3\x81\x8A\xE3\x81\xAF\xE3\x82\x88\xE3\x81\x86\xE3\x81\x94\xE3\x81\x96\xE3\x81\x84\xE3\x81\xBE\xE3\x81\x99\xEF\xBC\x81\n",
+      "Lesson: Vocal +25, Dance +10, Visual +5\n",
+      "\xE4\xBB\x8A\xE6\x97\xA5\xE3\x81\xAE\xE3\x83\xAC\xE3\x83\x83\xE3\x82\xB9\xE3\x83\xB3\xE3\x81\xAF Vocal \xE3\x81\xA7\xE3\x81\x99\xE3\x80\x82\n",
+      "\xF0\x9F\x8E\xA4 Live!\n",
+  };
+  std::string corpus;
+  corpus.reserve(corpus_size + 128);
+  for (size_t i = 0; corpus.size() < corpus_size; ++i) {
+    corpus += lines[i % std::size(lines)];
+  }
+  return corpus;
+}
+
+// Runs 'step' until the minimum duration is reached and prints MB/s of 'bytes'
+template <class Step>
+void measure(std::string_view name, size_t bytes, Step &&step) {
+  size_t rounds = 0;
+  auto const start = bench_clock::now();
+  auto elapsed = bench_clock::duration{};
+  do {
+    step();
+    ++rounds;
+    elapsed = bench_clock::now() - start;
+  } while (elapsed < min_duration);
+  auto const seconds = std::chrono::duration<double>(elapsed).count();
+  std::cout << name << ": " << (double(bytes) * rounds / seconds / (1 << 20))
+            << " MB/s" << std::endl;
+}
+
+int benchmarkTranscode(std::string const &corpus) {
+  std::cout << "Corpus: " << corpus.size() << " bytes of UTF-8" << std::endl;
+  auto const utf16 = imas::utility::toUtf16(corpus);
+  std::vector<char> utf16be;
+  imas::utility::appendUtf16BEFromUtf8(utf16be, corpus);
+  // Check the conversions before timing them
+  if (imas::utility::toUtf8(utf16) != corpus) {
+    std::cout << "Host order UTF-16 round trip mismatch" << std::endl;
+    return 1;
+  }
+  std::string check;
+  imas::utility::appendUtf8FromUtf16BE(check, utf16be);
+  if (check != corpus) {
+    std::cout << "Big-endian UTF-16 round trip mismatch (the corpus must not contain NUL)" << std::endl;
+    return 1;
+  }
+
+  std::string utf8_output;
+  std::u16string utf16_output;
+  std::vector<char> utf16be_output;
+  measure("UTF-8 -> UTF-16", corpus.size(), [&] {
+    utf16_output.clear();
+    imas::utility::appendUtf16FromUtf8(utf16_output, corpus);
+  });
+  measure("UTF-8 -> UTF-16BE", corpus.size(), [&] {
+    utf16be_output.clear();
+    imas::utility::appendUtf16BEFromUtf8(utf16be_output, corpus);
+  });
+  measure("UTF-16 -> UTF-8", corpus.size(), [&] {
+    utf8_output.clear();
+    imas::utility::appendUtf8FromUtf16(utf8_output, utf16);
+  });
+  measure("UTF-16BE -> UTF-8", corpus.size(), [&] {
+    utf8_output.clear();
+    imas::utility::appendUtf8FromUtf16BE(utf8_output, utf16be);
+  });
+  return 0;
+}
+
+// Phonetic runs in cells outside the read column used to hide every later
+// cell of the column
+bool checkXlsxReader(std::filesystem::path const &directory) {
+  constexpr std::string_view sheet =
+      "<worksheet xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\"><sheetData>"
+      "<row r=\"1\"><c r=\"A1\" t=\"inlineStr\"><is><r><t>kanji</t></r>"
+      "<rPh sb=\"0\" eb=\"5\"><t>kana</t></rPh></is></c>"
+      "<c r=\"C1\" t=\"inlineStr\"><is><t>one</t></is></c></row>"
+      "<row r=\"2\"><c r=\"C2\" t=\"s\"><v>1</v></c></row>"
+      "</sheetData></worksheet>";
+  constexpr std::string_view shared_strings =
+      "<sst xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\">"
+      "<si><t>kanji</t><rPh><t>kana</t></rPh></si><si><t>two</t><rPh><t>kana</t></rPh></si></sst>";
+  imas::utility::ZipWriter zip;
+  zip.addFile("xl/worksheets/sheet1.xml", sheet);
+  zip.addFile("xl/sharedStrings.xml", shared_strings);
+  auto const archive = zip.finish();
+  auto const path = directory / "reader_check.xlsx";
+  std::ofstream(path, std::ios_base::binary).write(archive.data(), archive.size());
+
+  imas::utility::XlsxReader reader;
+  std::map<int, std::string> cells;
+  auto const result = reader.open(path).first &&
+                      reader.readColumn(2, [&](int row, std::string_view text) {
+                        cells.emplace(row, text);
+                      }).first;
+  return result && cells == std::map<int, std::string>{{1, "one"}, {2, "two"}};
+}
+
+// Both paths write the MSG sheet layout: a header row and the text column
+int benchmarkXlsx(int file_count, size_t string_count) {
+  std::vector<std::string> strings;
+  auto const corpus = generateCorpus();
+  for (size_t start = 0; strings.size() < string_count;) {
+    auto const end = corpus.find('\n', start);
+    strings.push_back(corpus.substr(start, end - start));
+    start = end + 1;
+  }
+  auto const directory = std::filesystem::temp_directory_path() / "imasbench_xlsx";
+  std::filesystem::create_directories(directory);
+  if (!checkXlsxReader(directory)) {
+    std::cout << "XLSX reader check failed" << std::endl;
+    std::filesystem::remove_all(directory);
+    return 1;
+  }
+  auto const run = [&](std::string_view name, auto &&write) {
+    auto const start = bench_clock::now();
+    for (int i = 0; i < file_count; ++i) {
+      write(directory / (std::to_string(i) + ".xlsx"));
+    }
+    auto const seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    std::cout << name << ": " << file_count / seconds << " files/s" << std::endl;
+  };
+  run("Native writer", [&](std::filesystem::path const &path) {
+    imas::utility::XlsxWriter workbook;
+    workbook.addRow({"name", "text", "translated", "note", "issues"});
+    for (auto const &string : strings) {
+      workbook.addRow({"", string});
+    }
+    workbook.save(path);
+  });
+  run("OpenXLSX", [&](std::filesystem::path const &path) {
+    OpenXLSX::XLDocument doc;
+    doc.create(path.string(), true);
+    auto wks = doc.workbook().worksheet("Sheet1");
+    wks.row(1).values() = std::vector<std::string>{"name", "text", "translated", "note", "issues"};
+    for (size_t i = 0; i < strings.size(); ++i) {
+      wks.cell(i + 2, 2).value() = strings[i];
+    }
+    doc.save();
+  });
+  std::filesystem::remove_all(directory);
+  return 0;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cout << help_text;
+    return 1;
+  }
+  std::string_view const command = argv[1];
+  if (command == "transcode") {
+    if (argc < 3) {
+      return benchmarkTranscode(generateCorpus());
+    }
+    std::ifstream stream(argv[2], std::ios_base::binary);
+    if (!stream.is_open()) {
+      std::cout << "Failed to open " << argv[2] << std::endl;
+      return 1;
+    }
+    std::string corpus(std::filesystem::file_size(argv[2]), '\0');
+    stream.read(corpus.data(), corpus.size());
+    return benchmarkTranscode(corpus);
+  }
+  if (command == "xlsx") {
+    return benchmarkXlsx(argc > 2 ? std::max(1, std::atoi(argv[2])) : 100,
+                         argc > 3 ? std::max(1, std::atoi(argv[3])) : 1000);
+  }
+  std::cout << help_text;
+  return 1;
+}
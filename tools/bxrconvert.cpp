@@ -1,47 +1,266 @@
-
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 #include <utility/path.h>
 
 #include "filetypes/bxr.h"
 
-void testBXR(std::filesystem::path const &path) {
-  std::filesystem::path test_root = path.string() + "_test";
-  imas::path::iterateFiles(
-      path, ".bxr", [&path, &test_root](std::filesystem::path const &filepath) {
-        auto const rel = std::filesystem::relative(filepath, path);
-        std::filesystem::path xml_path = filepath;
-        xml_path.replace_extension(".xml");
-        std::filesystem::path test_path = test_root / rel;
-        std::filesystem::create_directories(test_path.parent_path());
-        {
-          imas::file::BXR bxr;
-          bxr.loadFromFile(filepath);
-          bxr.extract(xml_path);
-        }
-        {
-          imas::file::BXR bxr;
-          bxr.inject(xml_path);
-          bxr.saveToFile(test_path);
+namespace {
+using verify_clock = std::chrono::steady_clock;
+
+enum class Verdict { identical, equivalent, failed };
+
+struct VerifyReport {
+  std::filesystem::path path;
+  Verdict verdict = Verdict::failed;
+  std::string note;
+  verify_clock::duration export_time{};
+  verify_clock::duration import_time{};
+};
+
+std::vector<char> readFile(std::filesystem::path const &path) {
+  std::ifstream stream(path, std::ios_base::binary);
+  std::vector<char> data(std::filesystem::file_size(path));
+  stream.read(data.data(), data.size());
+  if (!stream) {
+    data.clear();
+  }
+  return data;
+}
+
+std::string exportXml(imas::file::BXR const &bxr) {
+  std::ostringstream stream;
+  bxr.exportXml(stream);
+  return std::move(stream).str();
+}
+
+// First line where two documents differ, for the report
+std::string firstDifference(std::string_view original, std::string_view rebuilt) {
+  auto const [left, right] = std::ranges::mismatch(original, rebuilt);
+  auto const line_start = original.rfind('\n', left - original.begin());
+  auto const line = 1 + std::count(original.begin(), left, '\n');
+  auto const start = line_start == std::string_view::npos ? 0 : line_start + 1;
+  auto const end = std::min(original.find('\n', start), original.size());
+  return "XML differs at line " + std::to_string(line) + ": " +
+         std::string(original.substr(start, std::min<size_t>(end - start, 120)));
+}
+
+// Round-trips one file in memory. Bytes are compared first; when the layout
+// differs, both files are exported again and the XML has to match.
+VerifyReport verifyFile(std::filesystem::path const &path, std::filesystem::path const &failure_dir) {
+  VerifyReport report{.path = path,
+                      .verdict = Verdict::failed,
+                      .note = {},
+                      .export_time = {},
+                      .import_time = {}};
+  auto const original = readFile(path);
+  auto const start = verify_clock::now();
+  imas::file::BXR bxr;
+  if (auto const result = bxr.loadFromData(original); !result.first) {
+    report.note = "load failed: " + result.second;
+    return report;
+  }
+  auto const xml = exportXml(bxr);
+  auto const middle = verify_clock::now();
+  imas::file::BXR rebuilt;
+  auto const result = rebuilt.importXml(xml);
+  std::vector<char> data;
+  if (result.first) {
+    rebuilt.saveToData(data);
+  }
+  report.export_time = middle - start;
+  report.import_time = verify_clock::now() - middle;
+  if (!result.first) {
+    report.note = "import failed: " + result.second;
+  } else if (data == original) {
+    report.verdict = Verdict::identical;
+    return report;
+  } else if (auto const rebuilt_xml = exportXml(rebuilt); rebuilt_xml == xml) {
+    report.verdict = Verdict::equivalent;
+    report.note = "bytes differ, content matches";
+    return report;
+  } else {
+    report.note = firstDifference(xml, rebuilt_xml);
+  }
+  // Keep what is needed to look into the failure
+  std::error_code ec;
+  std::filesystem::create_directories(failure_dir, ec);
+  auto const failure_path = failure_dir / path.filename();
+  std::ofstream(imas::path::changeExtension(failure_path, ".xml"), std::ios_base::binary) << xml;
+  if (!data.empty()) {
+    std::ofstream(imas::path::changeExtension(failure_path, ".rebuilt.bxr"), std::ios_base::binary)
+        .write(data.data(), data.size());
+  }
+  return report;
+}
+
+// Round-trips every BXR under 'path' on a pool of worker threads and reports
+// per-file timing and verdicts. Failures are kept in '<path>_test'.
+int verifyBXR(std::filesystem::path const &path, unsigned thread_count) {
+  auto const files = imas::path::collectFilepaths(path, ".bxr");
+  std::filesystem::path const test_root = path.string() + "_test";
+  std::vector<VerifyReport> reports(files.size());
+  std::atomic_size_t next_file = 0;
+  auto const start = verify_clock::now();
+  {
+    std::vector<std::jthread> workers;
+    for (unsigned i = 0; i < thread_count; ++i) {
+      workers.emplace_back([&] {
+        for (auto index = next_file++; index < files.size(); index = next_file++) {
+          std::filesystem::path const file = files[index];
+          auto const rel = std::filesystem::relative(file, path);
+          try {
+            reports[index] = verifyFile(file, (test_root / rel).parent_path());
+          } catch (std::exception const &e) {
+            reports[index] = {.path = file, .note = e.what()};
+          }
         }
       });
+    }
+  }
+  auto const wall_time = verify_clock::now() - start;
+
+  auto const ms = [](verify_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+  };
+  std::ranges::sort(reports, {}, &VerifyReport::path);
+  size_t counts[3] = {};
+  verify_clock::duration export_time{};
+  verify_clock::duration import_time{};
+  for (auto const &report : reports) {
+    ++counts[int(report.verdict)];
+    export_time += report.export_time;
+    import_time += report.import_time;
+    static constexpr char const *labels[] = {"PASS", "PASS", "FAIL"};
+    std::cout << labels[int(report.verdict)] << '\t' << ms(report.export_time) << '\t'
+              << ms(report.import_time) << '\t'
+              << std::filesystem::relative(report.path, path).string();
+    if (!report.note.empty()) {
+      std::cout << '\t' << report.note;
+    }
+    std::cout << '\n';
+  }
+  std::cout << "Verified " << reports.size() << " files on " << thread_count
+            << " threads in " << ms(wall_time) << " ms (export " << ms(export_time)
+            << " ms, import " << ms(import_time) << " ms in total)\n"
+            << counts[int(Verdict::identical)] << " identical, "
+            << counts[int(Verdict::equivalent)] << " equivalent, "
+            << counts[int(Verdict::failed)] << " failed" << std::endl;
+  return counts[int(Verdict::failed)] ? 1 : 0;
+}
+
+// Prints the matching elements of one file, a line per element
+size_t queryFile(std::filesystem::path const &filepath, std::string_view path,
+                 std::optional<std::pair<std::string_view, std::string_view>> const &filter) {
+  imas::file::BXR bxr;
+  if (auto const result = bxr.loadFromFile(filepath); !result.first) {
+    std::cout << filepath.string() << ": " << result.second << std::endl;
+    return 0;
+  }
+  auto const elements = filter ? bxr.find(path, filter->first, filter->second) : bxr.find(path);
+  for (auto const element : elements) {
+    std::cout << filepath.string() << '\t' << element << '\t' << bxr.tag(element);
+    for (auto const &[name, value] : bxr.fields(element)) {
+      std::cout << '\t' << name << '=' << value;
+    }
+    if (auto const unicode = bxr.unicode(element)) {
+      std::cout << "\tunicode=" << *unicode;
+    }
+    std::cout << '\n';
+  }
+  return elements.size();
 }
 
+int queryBXR(std::filesystem::path const &target, std::string_view path, std::string_view filter_text) {
+  std::optional<std::pair<std::string_view, std::string_view>> filter;
+  if (!filter_text.empty()) {
+    auto const separator = filter_text.find('=');
+    if (std::string_view::npos == separator) {
+      std::cout << "Filter must look like <field>=<value>" << std::endl;
+      return 1;
+    }
+    filter.emplace(filter_text.substr(0, separator), filter_text.substr(separator + 1));
+  }
+  size_t matches = 0;
+  if (std::filesystem::is_directory(target)) {
+    imas::path::iterateFiles(target, ".bxr", [&](std::filesystem::path const &filepath) {
+      matches += queryFile(filepath, path, filter);
+    });
+  } else {
+    matches = queryFile(target, path, filter);
+  }
+  std::cout << matches << " matches" << std::endl;
+  return matches ? 0 : 1;
+}
+// Prints a schema declaration for the tags of a file, ready for bxrschema.h
+int printSchema(std::filesystem::path const &filepath) {
+  imas::file::BXR bxr;
+  auto const result = filepath.extension() == ".xml" ? bxr.inject(filepath) : bxr.loadFromFile(filepath);
+  if (!result.first) {
+    std::cout << result.second << std::endl;
+    return 1;
+  }
+  if (0 == bxr.elementCount()) {
+    std::cout << "no elements" << std::endl;
+    return 1;
+  }
+  auto names = bxr.tagNames();
+  std::ranges::sort(names);
+  auto const root = bxr.tag(0);
+  std::cout << "inline constexpr BXRSchemaTable<" << names.size() << "> " << root << "_schema_tags({";
+  char const *separator = "";
+  for (auto const name : names) {
+    std::cout << separator << '"' << name << '"';
+    separator = ", ";
+  }
+  std::cout << "});\n"
+            << "    makeSchema(\"" << root << "\", " << root << "_schema_tags)," << std::endl;
+  return 0;
+}
+} // namespace
+
 int main(int argc, char *argv[])
 {
     if(argc < 2) {
-        std::cout << "Usage: " << argv[0] << " <*.brx/*.xml>" << std::endl;
+        std::cout << "Usage: " << argv[0] << " <*.brx/*.xml>" << std::endl
+                  << "To round-trip and verify every BXR in a directory:" << std::endl
+                  << argv[0] << " <directory> [thread count]" << std::endl
+                  << "To look up elements by tag path and field value:" << std::endl
+                  << argv[0] << " query <*.bxr/directory> <tag/path> [field=value]" << std::endl
+                  << "To print a schema declaration for the tags of a file:" << std::endl
+                  << argv[0] << " schema <*.bxr/*.xml>" << std::endl;
         std::string answer;
         std::getline(std::cin, answer);
         return 1;
     }
 
+    if(std::string_view(argv[1]) == "query") {
+      if(argc < 4) {
+        std::cout << "Usage: " << argv[0] << " query <*.bxr/directory> <tag/path> [field=value]" << std::endl;
+        return 1;
+      }
+      return queryBXR(argv[2], argv[3], argc > 4 ? argv[4] : "");
+    }
+
+    if(std::string_view(argv[1]) == "schema" && argc > 2) {
+      return printSchema(argv[2]);
+    }
+
     auto path = std::filesystem::path(argv[1]);
     //we can accept only .bxr or .xml files
     if(std::filesystem::is_directory(path)) {
-      testBXR(path);
-      return 0;
+      unsigned const thread_count = argc > 2 ? std::max(1, std::atoi(argv[2]))
+                                             : std::max(1u, std::thread::hardware_concurrency());
+      return verifyBXR(path, thread_count);
     }
     if(!std::filesystem::is_regular_file(path)) {
             std::cout << path << " is not a file."  << std::endl;
@@ -1,12 +1,18 @@
 
+#include <algorithm>
+#include <charconv>
 #include <format>
 #include <iostream>
+#include <optional>
 
 #include "filetypes/bna.h"
 #include "filetypes/bxr.h"
 #include "filetypes/nut.h"
 #include "filetypes/scb.h"
 #include "filetypes/scenario.h"
+#include "filetypes/textworkbook.h"
+#include "filetypes/texturecache.h"
+#include "filetypes/translationmemory.h"
 #include "utility/commandline.h"
 #include "utility/filetype.h"
 
@@ -55,13 +61,27 @@ if(auto const ret = func; ret.first) { \
 }
 
 constexpr auto help = "Idolm@ster patching tool.\n"
-"Usage: imaspatcher <command> <game folder> <patch folder> <script file> <output script>\n"
+"Usage: imaspatcher <command> <game folder> <patch folder> <script file> <output script> [options]\n"
 "Commands:\n"
 "  extract - exports game files to the patch folder\n"
 "  patch - patches game files with the files from the patch folder\n"
 "  unpack - unpacks game files 'as is', without conversion\n"
 "  replace - replaces files without conversion\n"
-"  validate - validate and clean the script file from unused entries\n";
+"  validate - validate and clean the script file from unused entries\n"
+"Options:\n"
+"  --workbook[=rows] - extract and patch script strings through shared workbooks\n"
+"                      (strings_001.xlsx, ...) instead of one workbook per script,\n"
+"                      starting a new workbook after 'rows' rows (default 100000,\n"
+"                      at most 1048575)\n"
+"  --memory=<file> - on patch, lines left untranslated take their translation\n"
+"                    from a translation memory (see bnamaster memory-build)\n";
+
+constexpr auto texture_cache_dir = ".texture_cache";
+constexpr auto workbook_option = "--workbook";
+constexpr auto memory_option = "--memory=";
+constexpr auto text_workbook_name = "strings";
+constexpr size_t default_workbook_rows = 100000;
+constexpr size_t max_workbook_rows = 1048576 - 1; // Excel's sheet limit, less the header row
 
 template <class T>
 void replaceExtension(std::filesystem::path& path, T const& filetype) {
@@ -80,6 +100,10 @@ struct TaskData {
   std::filesystem::path patch;
   std::filesystem::path script;
   std::filesystem::path out_script;
+  // Script strings go through shared workbooks instead of one per SCB
+  bool workbook = false;
+  size_t workbook_rows = default_workbook_rows;
+  std::filesystem::path memory;
 };
 
 imas::file::Result iterateBNA(TaskData const& task,
@@ -125,6 +149,10 @@ imas::file::Result extract(TaskData const& task) {
   if(auto const res = scenario.fromFile(task.script); !res.first) {
     return res;
   }
+  std::optional<imas::file::TextWorkbookWriter> workbook;
+  if (task.workbook) {
+    workbook.emplace(task.patch, text_workbook_name, task.workbook_rows);
+  }
   for(auto const& entry: scenario.entries) {
     auto const original_path = task.game / entry.path;
     imas::file::BNA bna;
@@ -165,9 +193,15 @@ imas::file::Result extract(TaskData const& task) {
         case imas::filetype::type::scb:
         {
           imas::file::SCB scb;
+          PRINT_ERROR_AND_CONTINUE(scb.loadFromData(file.file_data))
+          if (workbook) {
+            PRINT_ERROR_AND_CONTINUE(workbook->add(entry.path.generic_string(), subentry.generic_string(),
+                                                   scb.msg_data()))
+            std::cout << "Collected " << subentry << '\n';
+            break;
+          }
           replaceExtension(final_path, scb);
           makeDirs(final_path.parent_path());
-          PRINT_ERROR_AND_CONTINUE(scb.loadFromData(file.file_data))
           PRINT_ERROR_AND_CONTINUE(scb.extract(final_path))
           std::cout << "Extracted " << final_path << '\n';
         }
@@ -177,6 +211,14 @@ imas::file::Result extract(TaskData const& task) {
       }
     }
   }
+  if (workbook) {
+    if (auto const res = workbook->finish(); !res.first) {
+      return res;
+    }
+    for (auto const &shard : workbook->shards()) {
+      std::cout << "Saved " << shard << '\n';
+    }
+  }
   return {true, {"Data extracted."}};
 }
 
@@ -215,6 +257,24 @@ imas::file::Result patch(TaskData const& task) {
   if(auto const res = scenario.fromFile(task.script); !res.first) {
     return res;
   }
+  // Identical DDS files are common across archives, convert each one only once.
+  // The cache lives in the patch folder, which only its owner can fill anyway.
+  imas::file::TextureCache texture_cache(task.patch / texture_cache_dir);
+  // All translations are read up front and routed to their SCB by key
+  std::optional<imas::file::TextWorkbookReader> workbook;
+  if (task.workbook) {
+    workbook.emplace();
+    if (auto const res = workbook->load(task.patch, text_workbook_name); !res.first) {
+      return res;
+    }
+    std::cout << "Translations for " << workbook->fileCount() << " scripts loaded\n";
+  }
+  imas::file::TranslationMemory memory;
+  if (!task.memory.empty()) {
+    if (auto const res = memory.open(task.memory); !res.first) {
+      return res;
+    }
+  }
   for(auto const& entry: scenario.entries) {
     std::cout << "Working with archive " << entry.path.string() << ":\n";
     auto const original_path = task.game / entry.path;
@@ -253,13 +313,36 @@ imas::file::Result patch(TaskData const& task) {
           imas::file::NUT nut;
           final_path.replace_extension();
           nut.loadFromData(file.file_data);
+          nut.setImportOptions({.cache = &texture_cache});
           PRINT_ERROR_AND_CONTINUE(nut.inject(final_path));
+          // Every texture matches the embedded one, the archive can stay as is
+          if (!nut.changed()) {
+            std::cout << "unchanged\n";
+            continue;
+          }
           PRINT_RES(nut.saveToData(file.file_data));
         }
         break;
         case imas::filetype::type::scb:
         {
           imas::file::SCB scb;
+          if (memory.isOpen()) {
+            scb.msg_data().setImportOptions({.memory = &memory});
+          }
+          if (workbook) {
+            auto const strings = workbook->find(entry.path.generic_string(), subentry.generic_string());
+            if (!strings) {
+              std::cout << MAKE_ERROR("no rows in the workbooks");
+              continue;
+            }
+            PRINT_ERROR_AND_CONTINUE(scb.loadFromData(file.file_data))
+            auto new_strings = *strings;
+            // Trailing rows may have been deleted
+            new_strings.resize(std::max(new_strings.size(), scb.msg_data().entries().size()));
+            PRINT_ERROR_AND_CONTINUE(scb.setStrings(std::move(new_strings)));
+            PRINT_RES(scb.saveToData(file.file_data));
+            break;
+          }
           replaceExtension(final_path, scb);
           CHECK_FILE_SKIP(final_path)
           scb.loadFromData(file.file_data);
@@ -359,16 +442,37 @@ imas::file::Result validate(TaskData const& task) {
 
 int main(int argc, char const *argv[])
 {
-    if (argc < 5) {
+    TaskData task;
+    std::vector<std::string_view> args;
+    for (int i = 0; i < argc; ++i) {
+        std::string_view const arg = argv[i];
+        if (arg.starts_with(memory_option)) {
+            task.memory = arg.substr(std::string_view(memory_option).size());
+            continue;
+        }
+        if (!arg.starts_with(workbook_option)) {
+            args.push_back(arg);
+            continue;
+        }
+        task.workbook = true;
+        if (auto const value = arg.substr(std::string_view(workbook_option).size()); !value.empty()) {
+            auto const [end, ec] = std::from_chars(value.data() + 1, value.data() + value.size(), task.workbook_rows);
+            if ('=' != value.front() || ec != std::errc{} || end != value.data() + value.size() ||
+                0 == task.workbook_rows || task.workbook_rows > max_workbook_rows) {
+                std::cout << "Invalid option " << arg << '\n';
+                return 1;
+            }
+        }
+    }
+    if (args.size() < 5) {
         std::cout << help;
         std::string answer;
         std::getline(std::cin, answer);
         return 0;
     }
-    TaskData task;
-    task.game = argv[2];
-    task.script = argv[3];
-    task.patch = argv[4];
+    task.game = args[2];
+    task.script = args[3];
+    task.patch = args[4];
 
     //check if directory exists
     if (!std::filesystem::is_directory(task.game)) {
@@ -380,7 +484,7 @@ int main(int argc, char const *argv[])
         std::cout << "Script file " << task.script << " does not exist\n";
         return 1;
     }
-    switch (argv[1][0]) {
+    switch (args[1][0]) {
         case 'e': {
             return printResult(extract(task));
         }
@@ -394,12 +498,12 @@ int main(int argc, char const *argv[])
             return printResult(replace(task));
         }
         case 'v': {
-            if(argc < 6) {
+            if(args.size() < 6) {
                 std::cout << "Not enough arguments\n";
                 std::cout << help;
                 return 1;
             }
-            task.out_script = argv[5];
+            task.out_script = args[5];
             return printResult(validate(task));
         }
         default: {
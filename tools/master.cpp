@@ -1,18 +1,29 @@
 
 #include "utility/path.h"
 
+#include <charconv>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <optional>
 #include <ranges>
+#include <thread>
 
 #include <filetypes/bna.h>
+#include <filetypes/gametext.h>
 #include <filetypes/msg.h>
 #include <filetypes/nut.h>
 #include <filetypes/scb.h>
 #include <filetypes/scenario.h>
+#include <filetypes/textindex.h>
+#include <filetypes/textworkbook.h>
+#include <filetypes/translationmemory.h>
+#include <utility/stringtools.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
 
 // #define MAP_STRINGS
 
@@ -20,7 +31,22 @@ constexpr auto help =
     "Idolm@ster BNA charting tool.\n"
     "Usage: BNAMaster map [extension] <gamepath> <scenario_path>\n"
     "maps bna's internal files according to [extension] and writes them into "
-    "the <scenario_patch>";
+    "the <scenario_patch>\n"
+    "Usage: BNAMaster memory-build <gamepath> <memory file> [workbook folder]\n"
+    "builds or updates the translation memory of every script line; only "
+    "archives changed since the last build are read again. Translations are "
+    "taken from the strings_*.xlsx workbooks of imaspatcher --workbook\n"
+    "Usage: BNAMaster memory-query <memory file> <line>\n"
+    "prints the translation of a line and where the game uses it\n"
+    "Usage: BNAMaster dump-text <gamepath> <output file>\n"
+    "writes every script line of the game as tab separated archive, subfile, "
+    "index and text columns; gzipped when the output name ends with .gz\n"
+    "Usage: BNAMaster search-build <gamepath> <index file>\n"
+    "builds the search index of every script line\n"
+    "Usage: BNAMaster search <index file> <phrase> [limit]\n"
+    "prints the archive, subfile and index of the lines containing <phrase>";
+
+constexpr auto text_workbook_name = "strings";
 
 template <typename _Pred>
 void iterateBNA(std::filesystem::path const &gamepath, _Pred const &callback) {
@@ -108,6 +134,209 @@ void mapBNA(std::filesystem::path const &gamepath, std::string const &filetype,
   output << boost::json::serialize(json) << std::endl;
 }
 
+int buildMemory(std::filesystem::path const &gamepath, std::filesystem::path const &memory_path,
+                std::filesystem::path const &workbook_path) {
+  imas::file::TranslationMemory previous;
+  if (std::filesystem::exists(memory_path)) {
+    if (auto const res = previous.open(memory_path); !res.first) {
+      std::cout << res.second << ", building from scratch" << std::endl;
+    }
+  }
+  std::optional<imas::file::TextWorkbookReader> workbooks;
+  if (!workbook_path.empty()) {
+    workbooks.emplace();
+    if (auto const res = workbooks->load(workbook_path, text_workbook_name); !res.first) {
+      std::cout << res.second << std::endl;
+      return 1;
+    }
+  }
+
+  auto archives = imas::file::listArchives(gamepath);
+  std::vector<char> reused(archives.size());
+  for (size_t i = 0; i < archives.size(); ++i) {
+    reused[i] = previous.isOpen() && previous.findArchive(archives[i].name, archives[i].stamp);
+  }
+  imas::file::readArchiveText(gamepath, archives, std::max(1u, std::thread::hardware_concurrency()),
+                              [&](imas::file::ArchiveText const &archive) {
+                                return !reused[&archive - archives.data()];
+                              });
+
+  imas::file::TranslationMemoryBuilder builder;
+  size_t reused_count = 0;
+  for (size_t i = 0; i < archives.size(); ++i) {
+    auto &archive = archives[i];
+    if (reused[i]) {
+      builder.reuseArchive(previous, archive.name, archive.stamp);
+      ++reused_count;
+      continue;
+    }
+    if (!archive.error.empty()) {
+      std::cout << archive.name << ": " << archive.error << std::endl;
+      // Stamped as changed, so the next build tries it again
+      archive.stamp = 0;
+    }
+    builder.addArchive(archive.name, archive.stamp);
+    for (auto &script : archive.scripts) {
+      std::vector<std::string> strings;
+      strings.reserve(script.strings.size());
+      for (auto const &string : script.strings) {
+        strings.push_back(imas::utility::toUtf8(string));
+      }
+      builder.addScript(archive.name, archive.stamp, std::move(script.subfile), std::move(strings));
+    }
+  }
+  previous.forEachTranslation([&](std::string_view source, std::string_view translation) {
+    builder.addTranslation(source, translation);
+  });
+  if (workbooks) {
+    builder.addTranslations([&](std::string_view archive, std::string_view subfile) {
+      return workbooks->find(archive, subfile);
+    });
+  }
+  previous.close();
+  if (auto const res = builder.save(memory_path); !res.first) {
+    std::cout << res.second << std::endl;
+    return 1;
+  }
+  std::cout << archives.size() << " archives, " << archives.size() - reused_count
+            << " of them read again" << std::endl;
+  return 0;
+}
+
+// Keeps every row on one line, so the dump stays greppable
+void appendEscapedText(std::string &output, std::string_view text) {
+  for (auto const c : text) {
+    switch (c) {
+    case '\\':
+      output += "\\\\";
+      break;
+    case '\t':
+      output += "\\t";
+      break;
+    case '\n':
+      output += "\\n";
+      break;
+    case '\r':
+      output += "\\r";
+      break;
+    default:
+      output += c;
+    }
+  }
+}
+
+int dumpText(std::filesystem::path const &gamepath, std::filesystem::path const &output_path) {
+  namespace io = boost::iostreams;
+  auto const start = std::chrono::steady_clock::now();
+  auto archives = imas::file::listArchives(gamepath);
+  imas::file::readArchiveText(gamepath, archives, std::max(1u, std::thread::hardware_concurrency()));
+
+  std::ofstream file(output_path, std::ios_base::binary);
+  if (!file.is_open()) {
+    std::cout << "Failed to create " << output_path << std::endl;
+    return 1;
+  }
+  io::filtering_ostream stream;
+  if (output_path.extension() == ".gz") {
+    stream.push(io::gzip_compressor(io::gzip_params(io::gzip::best_speed)));
+  }
+  stream.push(file);
+  stream << "archive\tsubfile\tindex\ttext\n";
+  // Rows are rendered an archive at a time and written in one go
+  size_t line_count = 0;
+  std::string rows;
+  std::string text;
+  for (auto const &archive : archives) {
+    if (!archive.error.empty()) {
+      std::cout << archive.name << ": " << archive.error << std::endl;
+    }
+    rows.clear();
+    for (auto const &script : archive.scripts) {
+      for (size_t i = 0; i < script.strings.size(); ++i) {
+        text.clear();
+        imas::utility::appendUtf8FromUtf16(text, script.strings[i]);
+        rows += archive.name;
+        rows += '\t';
+        rows += script.subfile;
+        rows += '\t';
+        rows += std::to_string(i);
+        rows += '\t';
+        appendEscapedText(rows, text);
+        rows += '\n';
+      }
+      line_count += script.strings.size();
+    }
+    stream.write(rows.data(), rows.size());
+  }
+  stream.reset();
+  if (!file) {
+    std::cout << "Failed to write " << output_path << std::endl;
+    return 1;
+  }
+  auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << line_count << " lines from " << archives.size() << " archives in " << seconds << " s"
+            << std::endl;
+  return 0;
+}
+
+int queryMemory(std::filesystem::path const &memory_path, std::string_view line) {
+  imas::file::TranslationMemory memory;
+  if (auto const res = memory.open(memory_path); !res.first) {
+    std::cout << res.second << std::endl;
+    return 1;
+  }
+  auto const id = memory.find(line);
+  if (!id) {
+    std::cout << "The line is not used by the game" << std::endl;
+    return 1;
+  }
+  auto const translation = memory.translation(*id);
+  std::cout << "Translation: " << (translation.empty() ? "(none)" : translation) << std::endl;
+  for (auto const &location : memory.occurrences(*id)) {
+    std::cout << location.archive << ' ' << location.subfile << ':' << location.index << std::endl;
+  }
+  return 0;
+}
+
+int buildSearchIndex(std::filesystem::path const &gamepath, std::filesystem::path const &index_path) {
+  auto const start = std::chrono::steady_clock::now();
+  auto const thread_count = std::max(1u, std::thread::hardware_concurrency());
+  auto archives = imas::file::listArchives(gamepath);
+  imas::file::readArchiveText(gamepath, archives, thread_count);
+  for (auto const &archive : archives) {
+    if (!archive.error.empty()) {
+      std::cout << archive.name << ": " << archive.error << std::endl;
+    }
+  }
+  if (auto const res = imas::file::TextIndex::build(archives, thread_count, index_path); !res.first) {
+    std::cout << res.second << std::endl;
+    return 1;
+  }
+  auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "Indexed " << archives.size() << " archives in " << seconds << " s" << std::endl;
+  return 0;
+}
+
+int search(std::filesystem::path const &index_path, std::string_view phrase, size_t limit) {
+  imas::file::TextIndex index;
+  if (auto const res = index.open(index_path); !res.first) {
+    std::cout << res.second << std::endl;
+    return 1;
+  }
+  auto const start = std::chrono::steady_clock::now();
+  auto const matches = index.search(phrase, limit);
+  auto const milliseconds =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::string text;
+  for (auto const &match : matches) {
+    text.clear();
+    appendEscapedText(text, match.text);
+    std::cout << match.archive << ' ' << match.subfile << ':' << match.index << '\t' << text << '\n';
+  }
+  std::cout << matches.size() << " matches in " << milliseconds << " ms" << std::endl;
+  return 0;
+}
+
 // bool compareFiles(std::filesystem::path const &p1,
 //                   std::filesystem::path const &p2) {
 //   std::ifstream f1(p1, std::ifstream::binary | std::ifstream::ate);
@@ -172,6 +401,35 @@ int main(int argc, char *argv[]) {
     mapBNA(gamepath, filetype, scenario_path);
   }
 
+  if (command == "memory-build" && argc > 3) {
+    return buildMemory(argv[2], argv[3], argc > 4 ? argv[4] : "");
+  }
+
+  if (command == "memory-query" && argc > 3) {
+    return queryMemory(argv[2], argv[3]);
+  }
+
+  if (command == "dump-text" && argc > 3) {
+    return dumpText(argv[2], argv[3]);
+  }
+
+  if (command == "search-build" && argc > 3) {
+    return buildSearchIndex(argv[2], argv[3]);
+  }
+
+  if (command == "search" && argc > 3) {
+    auto limit = std::numeric_limits<size_t>::max();
+    if (argc > 4) {
+      std::string_view const value = argv[4];
+      auto const [end, ec] = std::from_chars(value.data(), value.data() + value.size(), limit);
+      if (ec != std::errc{} || end != value.data() + value.size()) {
+        std::cout << help << std::endl;
+        return -1;
+      }
+    }
+    return search(argv[2], argv[3], limit);
+  }
+
   // if (command == "compare") {
   //   auto const nut_path = std::string(argv[2]);
   //   auto const bna_path = std::string(argv[3]);
@@ -8,7 +8,10 @@ constexpr auto help_text =
     "To unpack a NUT file:\n"
     "nuttool <filename>\n"
     "To pack a folder into a NUT file:\n"
-    "nuttool <directory> or nuttool <directory> <filename>";
+    "nuttool <directory> or nuttool <directory> <filename>\n"
+    "Add -m to generate mipmaps from the base level of every DDS\n"
+    "To export a NUT file as PNG images:\n"
+    "nuttool png <filename> [mipmap level]";
 
 void unpackFile(std::filesystem::path const& filepath, std::filesystem::path const& dirpath)
 {
@@ -27,8 +30,22 @@ void unpackFile(std::filesystem::path const& filepath)
   unpackFile(filepath, final_dir);
 }
 
+void exportPNG(std::filesystem::path const& filepath, int mip_level)
+{
+  imas::file::NUT nut;
+  STOP_ON_ERROR(nut.loadFromFile(filepath));
+  auto const final_dir = filepath.parent_path() / filepath.stem();
+  if (!std::filesystem::exists(final_dir)) {
+    std::filesystem::create_directory(final_dir);
+  }
+  printResult(nut.exportPNG(final_dir, mip_level));
+}
+
+bool generate_mipmaps = false;
+
 void packDir(std::filesystem::path const& dirpath, std::filesystem::path const& filepath) {
   imas::file::NUT nut;
+  nut.setImportOptions({.generate_mipmaps = generate_mipmaps});
   STOP_ON_ERROR(nut.loadDDS(dirpath));
   nut.saveToFile(filepath);
 }
@@ -48,6 +65,21 @@ int main(int argc, char *argv[])
     std::getline(std::cin, answer);
     return 1;
   }
+  if (argc > 2 && std::string_view(argv[argc - 1]) == "-m")
+  {
+    generate_mipmaps = true;
+    --argc;
+  }
+  if (std::string_view(argv[1]) == "png")
+  {
+    if (argc < 3 || !std::filesystem::is_regular_file(argv[2]))
+    {
+      std::cout << help_text;
+      return 1;
+    }
+    exportPNG(argv[2], argc > 3 ? std::atoi(argv[3]) : 0);
+    return 0;
+  }
   switch (argc)
   {
   case 2:
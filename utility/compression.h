@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+namespace imas {
+namespace utility {
+
+enum class DeflateFormat
+{
+  zlib, // zlib header and adler32 trailer (PNG)
+  raw   // bare deflate stream (ZIP)
+};
+
+inline std::vector<char> deflate(std::span<char const> data,
+                                 DeflateFormat format = DeflateFormat::zlib,
+                                 int level = boost::iostreams::zlib::best_speed) {
+  namespace io = boost::iostreams;
+  io::zlib_params params(level);
+  params.noheader = DeflateFormat::raw == format;
+  std::vector<char> output;
+  output.reserve(data.size() / 2);
+  {
+    io::filtering_ostream stream;
+    stream.push(io::zlib_compressor(params));
+    stream.push(io::back_inserter(output));
+    stream.write(data.data(), data.size());
+  }
+  return output;
+}
+
+// Fails once the output grows past 'max_size', so a bad stream can't make it
+// balloon
+inline bool inflate(std::span<char const> data, std::vector<char> &output,
+                    DeflateFormat format = DeflateFormat::zlib,
+                    size_t max_size = std::numeric_limits<size_t>::max()) {
+  namespace io = boost::iostreams;
+  io::zlib_params params;
+  params.noheader = DeflateFormat::raw == format;
+  try {
+    io::filtering_istream stream;
+    stream.push(io::zlib_decompressor(params));
+    stream.push(io::array_source(data.data(), data.size()));
+    // zlib errors are rethrown rather than ending the loop quietly
+    stream.exceptions(std::ios_base::badbit);
+    std::array<char, 0x10000> chunk;
+    while (stream.read(chunk.data(), chunk.size()) || stream.gcount() > 0) {
+      if (size_t(stream.gcount()) > max_size - output.size()) {
+        return false;
+      }
+      output.insert(output.end(), chunk.data(), chunk.data() + stream.gcount());
+    }
+  } catch (std::exception const &) {
+    return false;
+  }
+  return true;
+}
+
+} // namespace utility
+} // namespace imas
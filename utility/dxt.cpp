@@ -0,0 +1,286 @@
+#include "dxt.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+typedef std::array<uint8_t, 4> Pixel;
+typedef std::array<Pixel, 16> Tile;
+
+inline uint16_t loadWord(char const *data, bool big_endian) {
+  auto const first = uint8_t(data[0]);
+  auto const second = uint8_t(data[1]);
+  return big_endian ? (first << 8) | second : (second << 8) | first;
+}
+
+inline void storeWord(char *data, uint16_t value, bool big_endian) {
+  data[big_endian ? 0 : 1] = char(value >> 8);
+  data[big_endian ? 1 : 0] = char(value & 0xFF);
+}
+
+inline uint16_t pack565(Pixel const &pixel) {
+  return ((pixel[0] >> 3) << 11) | ((pixel[1] >> 2) << 5) | (pixel[2] >> 3);
+}
+
+inline int distance(Pixel const &a, Pixel const &b) {
+  auto const r = a[0] - b[0];
+  auto const g = a[1] - b[1];
+  auto const b_ = a[2] - b[2];
+  return r * r + g * g + b_ * b_;
+}
+
+inline Pixel expand565(uint16_t color) {
+  uint8_t const r = (color >> 11) & 0x1F;
+  uint8_t const g = (color >> 5) & 0x3F;
+  uint8_t const b = color & 0x1F;
+  return {uint8_t((r << 3) | (r >> 2)), uint8_t((g << 2) | (g >> 4)),
+          uint8_t((b << 3) | (b >> 2)), 0xFF};
+}
+
+inline Pixel mix(Pixel const &a, Pixel const &b, int weight_a, int weight_b, int divisor) {
+  return {uint8_t((a[0] * weight_a + b[0] * weight_b) / divisor),
+          uint8_t((a[1] * weight_a + b[1] * weight_b) / divisor),
+          uint8_t((a[2] * weight_a + b[2] * weight_b) / divisor), 0xFF};
+}
+
+std::array<Pixel, 4> colorPalette(uint16_t color0, uint16_t color1, bool allow_transparent) {
+  std::array<Pixel, 4> palette;
+  palette[0] = expand565(color0);
+  palette[1] = expand565(color1);
+  if (color0 > color1 || !allow_transparent) {
+    palette[2] = mix(palette[0], palette[1], 2, 1, 3);
+    palette[3] = mix(palette[0], palette[1], 1, 2, 3);
+  } else {
+    palette[2] = mix(palette[0], palette[1], 1, 1, 2);
+    palette[3] = {0, 0, 0, 0};
+  }
+  return palette;
+}
+
+std::array<uint8_t, 8> alphaPalette(uint8_t alpha0, uint8_t alpha1) {
+  std::array<uint8_t, 8> palette;
+  palette[0] = alpha0;
+  palette[1] = alpha1;
+  if (palette[0] > palette[1]) {
+    for (int i = 1; i < 7; ++i) {
+      palette[i + 1] = ((7 - i) * palette[0] + i * palette[1]) / 7;
+    }
+  } else {
+    for (int i = 1; i < 5; ++i) {
+      palette[i + 1] = ((5 - i) * palette[0] + i * palette[1]) / 5;
+    }
+    palette[6] = 0;
+    palette[7] = 0xFF;
+  }
+  return palette;
+}
+
+// words[0..3] hold the color part: two 565 endpoints and 32 bits of indices
+void decodeColor(uint16_t const *words, bool allow_transparent, Tile &tile) {
+  auto const palette = colorPalette(words[0], words[1], allow_transparent);
+  uint32_t const indices = words[2] | (uint32_t(words[3]) << 16);
+  for (int i = 0; i < 16; ++i) {
+    tile[i] = palette[(indices >> (i * 2)) & 0x3];
+  }
+}
+
+// Explicit 4-bit alpha, four pixels per word
+void decodeAlphaBC2(uint16_t const *words, Tile &tile) {
+  for (int i = 0; i < 16; ++i) {
+    uint8_t const alpha = (words[i / 4] >> ((i % 4) * 4)) & 0xF;
+    tile[i][3] = alpha * 17;
+  }
+}
+
+// Two 8-bit endpoints and 48 bits of 3-bit indices
+void decodeAlphaBC3(uint16_t const *words, Tile &tile) {
+  auto const palette = alphaPalette(words[0] & 0xFF, words[0] >> 8);
+  uint64_t const indices = words[1] | (uint64_t(words[2]) << 16) | (uint64_t(words[3]) << 32);
+  for (int i = 0; i < 16; ++i) {
+    tile[i][3] = palette[(indices >> (i * 3)) & 0x7];
+  }
+}
+
+// BC1 transparency is only used when the block has (nearly) transparent pixels
+void encodeColor(Tile const &tile, bool allow_transparent, uint16_t *words) {
+  Pixel low = {0xFF, 0xFF, 0xFF, 0xFF};
+  Pixel high = {0, 0, 0, 0};
+  bool transparent = false;
+  for (auto const &pixel : tile) {
+    if (allow_transparent && pixel[3] < 0x80) {
+      transparent = true;
+      continue;
+    }
+    for (int channel = 0; channel < 3; ++channel) {
+      low[channel] = std::min(low[channel], pixel[channel]);
+      high[channel] = std::max(high[channel], pixel[channel]);
+    }
+  }
+  // Pull the endpoints in a little, so the interpolated colors cover the box better
+  for (int channel = 0; channel < 3; ++channel) {
+    auto const inset = (high[channel] - low[channel]) / 16;
+    low[channel] = std::min(255, low[channel] + inset);
+    high[channel] = std::max(0, high[channel] - inset);
+  }
+  auto color0 = pack565(high);
+  auto color1 = pack565(low);
+  if (transparent) {
+    // Three color mode is selected by color0 <= color1
+    if (color0 > color1) {
+      std::swap(color0, color1);
+    }
+  } else if (color0 < color1) {
+    std::swap(color0, color1);
+  }
+  auto const palette = colorPalette(color0, color1, allow_transparent);
+  uint32_t indices = 0;
+  if (color0 != color1 || transparent) {
+    for (int i = 0; i < 16; ++i) {
+      uint32_t best = 0;
+      if (transparent && tile[i][3] < 0x80) {
+        best = 3;
+      } else {
+        auto const candidates = transparent ? 3 : 4;
+        auto best_distance = distance(tile[i], palette[0]);
+        for (int index = 1; index < candidates; ++index) {
+          if (auto const dist = distance(tile[i], palette[index]); dist < best_distance) {
+            best_distance = dist;
+            best = index;
+          }
+        }
+      }
+      indices |= best << (i * 2);
+    }
+  }
+  words[0] = color0;
+  words[1] = color1;
+  words[2] = indices & 0xFFFF;
+  words[3] = indices >> 16;
+}
+
+void encodeAlphaBC2(Tile const &tile, uint16_t *words) {
+  for (int word = 0; word < 4; ++word) {
+    words[word] = 0;
+    for (int i = 0; i < 4; ++i) {
+      uint16_t const alpha = (tile[word * 4 + i][3] + 8) / 17;
+      words[word] |= alpha << (i * 4);
+    }
+  }
+}
+
+void encodeAlphaBC3(Tile const &tile, uint16_t *words) {
+  uint8_t low = 0xFF;
+  uint8_t high = 0;
+  for (auto const &pixel : tile) {
+    low = std::min(low, pixel[3]);
+    high = std::max(high, pixel[3]);
+  }
+  // Eight level mode needs alpha0 > alpha1; a flat block only uses index 0
+  auto const palette = alphaPalette(high, low);
+  uint64_t indices = 0;
+  if (high != low) {
+    for (int i = 0; i < 16; ++i) {
+      uint64_t best = 0;
+      auto best_distance = std::abs(tile[i][3] - palette[0]);
+      for (int index = 1; index < 8; ++index) {
+        if (auto const dist = std::abs(tile[i][3] - palette[index]); dist < best_distance) {
+          best_distance = dist;
+          best = index;
+        }
+      }
+      indices |= best << (i * 3);
+    }
+  }
+  words[0] = high | (low << 8);
+  words[1] = indices & 0xFFFF;
+  words[2] = (indices >> 16) & 0xFFFF;
+  words[3] = (indices >> 32) & 0xFFFF;
+}
+} // namespace
+
+namespace imas {
+namespace utility {
+
+void decodeBlocks(std::span<char const> data, BlockFormat format, int width,
+                  int height, Image &image, bool big_endian) {
+  image.resize(width, height);
+  auto const block_size = blockSize(format);
+  auto const blocks_x = std::max(1, (width + 3) / 4);
+  auto const blocks_y = std::max(1, (height + 3) / 4);
+  auto block = data.data();
+  std::array<uint16_t, 8> words;
+  Tile tile;
+  for (int by = 0; by < blocks_y; ++by) {
+    for (int bx = 0; bx < blocks_x; ++bx, block += block_size) {
+      if (block + block_size > data.data() + data.size()) {
+        return;
+      }
+      for (int i = 0; i < block_size / 2; ++i) {
+        words[i] = loadWord(block + i * 2, big_endian);
+      }
+      switch (format) {
+      case BlockFormat::bc1:
+        decodeColor(words.data(), true, tile);
+        break;
+      case BlockFormat::bc2:
+        decodeColor(words.data() + 4, false, tile);
+        decodeAlphaBC2(words.data(), tile);
+        break;
+      case BlockFormat::bc3:
+        decodeColor(words.data() + 4, false, tile);
+        decodeAlphaBC3(words.data(), tile);
+        break;
+      }
+      // Copy the tile row by row, clipping blocks that hang over the edge
+      auto const x = bx * 4;
+      auto const columns = std::min(4, width - x);
+      for (int row = 0; row < 4 && by * 4 + row < height; ++row) {
+        std::memcpy(image.row(by * 4 + row) + x * 4, tile[row * 4].data(), columns * 4);
+      }
+    }
+  }
+}
+
+void encodeBlocks(Image const &image, BlockFormat format,
+                  std::vector<char> &output, bool big_endian) {
+  auto const block_size = blockSize(format);
+  auto const blocks_x = std::max(1, (image.width + 3) / 4);
+  auto const blocks_y = std::max(1, (image.height + 3) / 4);
+  auto const start = output.size();
+  output.resize(start + surfaceSize(format, image.width, image.height));
+  auto block = output.data() + start;
+  std::array<uint16_t, 8> words;
+  Tile tile;
+  for (int by = 0; by < blocks_y; ++by) {
+    for (int bx = 0; bx < blocks_x; ++bx, block += block_size) {
+      // Blocks hanging over the edge repeat the last row/column
+      for (int i = 0; i < 16; ++i) {
+        auto const x = std::min(bx * 4 + i % 4, image.width - 1);
+        auto const y = std::min(by * 4 + i / 4, image.height - 1);
+        std::memcpy(tile[i].data(), image.row(y) + x * 4, 4);
+      }
+      switch (format) {
+      case BlockFormat::bc1:
+        encodeColor(tile, true, words.data());
+        break;
+      case BlockFormat::bc2:
+        encodeAlphaBC2(tile, words.data());
+        encodeColor(tile, false, words.data() + 4);
+        break;
+      case BlockFormat::bc3:
+        encodeAlphaBC3(tile, words.data());
+        encodeColor(tile, false, words.data() + 4);
+        break;
+      }
+      for (int i = 0; i < block_size / 2; ++i) {
+        storeWord(block + i * 2, words[i], big_endian);
+      }
+    }
+  }
+}
+
+} // namespace utility
+} // namespace imas
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "utility/image.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+
+namespace imas {
+namespace utility {
+
+enum class BlockFormat
+{
+  bc1, // DXT1
+  bc2, // DXT3
+  bc3  // DXT5
+};
+
+constexpr int blockSize(BlockFormat format) {
+  return BlockFormat::bc1 == format ? 8 : 16;
+}
+
+constexpr size_t surfaceSize(BlockFormat format, int width, int height) {
+  auto const blocks_x = std::max(1, (width + 3) / 4);
+  auto const blocks_y = std::max(1, (height + 3) / 4);
+  return size_t(blocks_x) * blocks_y * blockSize(format);
+}
+
+// Decodes a block compressed surface into 'image'.
+// Blocks are treated as a sequence of 16-bit words; NUT keeps them byteswapped,
+// so 'big_endian' lets the decoder read them in place without a swapped copy.
+void decodeBlocks(std::span<char const> data, BlockFormat format, int width,
+                  int height, Image &image, bool big_endian = false);
+// Compresses 'image' and appends the blocks to 'output'.
+// Endpoints are picked from the block's bounding box, which is fast and good
+// enough for mipmaps; it is not meant to replace a proper texture compressor.
+void encodeBlocks(Image const &image, BlockFormat format,
+                  std::vector<char> &output, bool big_endian = false);
+
+} // namespace utility
+} // namespace imas
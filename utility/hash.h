@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+namespace imas {
+namespace utility {
+
+// MurmurHash64A. Stable between runs, so hashes can be stored on disk.
+inline uint64_t hash64(std::span<char const> data, uint64_t seed = 0) {
+  constexpr uint64_t m = 0xc6a4a7935bd1e995ULL;
+  constexpr int r = 47;
+  uint64_t hash = seed ^ (data.size() * m);
+  auto const blocks = data.size() / 8;
+  auto const begin = data.data();
+  for (size_t i = 0; i < blocks; ++i) {
+    uint64_t k;
+    std::memcpy(&k, begin + i * 8, sizeof(k));
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    hash ^= k;
+    hash *= m;
+  }
+  auto const tail = reinterpret_cast<uint8_t const *>(begin + blocks * 8);
+  switch (data.size() & 7) {
+  case 7: hash ^= uint64_t(tail[6]) << 48; [[fallthrough]];
+  case 6: hash ^= uint64_t(tail[5]) << 40; [[fallthrough]];
+  case 5: hash ^= uint64_t(tail[4]) << 32; [[fallthrough]];
+  case 4: hash ^= uint64_t(tail[3]) << 24; [[fallthrough]];
+  case 3: hash ^= uint64_t(tail[2]) << 16; [[fallthrough]];
+  case 2: hash ^= uint64_t(tail[1]) << 8; [[fallthrough]];
+  case 1: hash ^= uint64_t(tail[0]);
+          hash *= m;
+  }
+  hash ^= hash >> r;
+  hash *= m;
+  hash ^= hash >> r;
+  return hash;
+}
+
+} // namespace utility
+} // namespace imas
@@ -0,0 +1,103 @@
+#include "image.h"
+
+#include "utility/compression.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+
+#include <boost/crc.hpp>
+
+namespace {
+constexpr std::array<char, 8> png_signature = {'\x89', 'P', 'N', 'G', '\r', '\n', '\x1A', '\n'};
+constexpr char png_color_rgba = 6;
+
+void putLong(std::vector<char> &output, uint32_t value) {
+  output.push_back(char(value >> 24));
+  output.push_back(char(value >> 16));
+  output.push_back(char(value >> 8));
+  output.push_back(char(value));
+}
+
+// length, type, data, crc(type + data)
+void putChunk(std::vector<char> &output, char const *type, std::span<char const> data) {
+  putLong(output, data.size());
+  auto const crc_start = output.size();
+  output.insert(output.end(), type, type + 4);
+  output.insert(output.end(), data.begin(), data.end());
+  boost::crc_32_type crc;
+  crc.process_bytes(output.data() + crc_start, output.size() - crc_start);
+  putLong(output, crc.checksum());
+}
+} // namespace
+
+namespace imas {
+namespace utility {
+
+Image downsample(Image const &image) {
+  Image result;
+  result.resize(std::max(1, image.width / 2), std::max(1, image.height / 2));
+  // Odd edges collapse into the last sample instead of reading past the image
+  auto const next_x = image.width > 1 ? 4 : 0;
+  for (int y = 0; y < result.height; ++y) {
+    auto const top = image.row(std::min(y * 2, image.height - 1));
+    auto const bottom = image.row(std::min(y * 2 + 1, image.height - 1));
+    auto target = result.row(y);
+    for (int x = 0; x < result.width; ++x, target += 4) {
+      auto const offset = x * 8;
+      for (int channel = 0; channel < 4; ++channel) {
+        auto const i = offset + channel;
+        target[channel] = (top[i] + top[i + next_x] + bottom[i] + bottom[i + next_x] + 2) / 4;
+      }
+    }
+  }
+  return result;
+}
+
+int mipmapCount(int width, int height) {
+  int count = 1;
+  for (auto size = std::max(width, height); size > 1; size /= 2) {
+    ++count;
+  }
+  return count;
+}
+
+file::Result savePNG(Image const &image, std::filesystem::path const &filepath) {
+  if (image.width <= 0 || image.height <= 0) {
+    return {false, "empty image"};
+  }
+  std::vector<char> header;
+  putLong(header, image.width);
+  putLong(header, image.height);
+  header.push_back(8); // bit depth
+  header.push_back(png_color_rgba);
+  header.push_back(0); // compression
+  header.push_back(0); // filter
+  header.push_back(0); // interlace
+
+  // Every scanline is prefixed with the filter type. "None" keeps encoding
+  // a plain copy; deflate does the rest.
+  size_t const stride = size_t(image.width) * 4;
+  std::vector<char> scanlines((stride + 1) * image.height);
+  for (int y = 0; y < image.height; ++y) {
+    auto const line = scanlines.data() + (stride + 1) * y;
+    line[0] = 0;
+    std::memcpy(line + 1, image.row(y), stride);
+  }
+
+  std::vector<char> output(png_signature.begin(), png_signature.end());
+  putChunk(output, "IHDR", header);
+  putChunk(output, "IDAT", deflate(scanlines));
+  putChunk(output, "IEND", {});
+
+  std::ofstream stream(filepath, std::ios_base::binary);
+  if (!stream.is_open()) {
+    return {false, "failed to create file " + filepath.string()};
+  }
+  stream.write(output.data(), output.size());
+  return {true, filepath.string()};
+}
+
+} // namespace utility
+} // namespace imas
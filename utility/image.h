@@ -0,0 +1,35 @@
+#pragma once
+
+#include "utility/result.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace imas {
+namespace utility {
+
+// Plain 8-bit RGBA image, rows go top to bottom without padding
+struct Image {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> pixels;
+
+  void resize(int new_width, int new_height) {
+    width = new_width;
+    height = new_height;
+    pixels.resize(size_t(width) * height * 4);
+  }
+  uint8_t *row(int y) { return pixels.data() + size_t(y) * width * 4; }
+  uint8_t const *row(int y) const { return pixels.data() + size_t(y) * width * 4; }
+};
+
+// Halves both dimensions (down to 1) with a 2x2 box filter
+Image downsample(Image const &image);
+// Amount of levels in a full mipmap chain, down to 1x1
+int mipmapCount(int width, int height);
+
+file::Result savePNG(Image const &image, std::filesystem::path const &filepath);
+
+} // namespace utility
+} // namespace imas
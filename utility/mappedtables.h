@@ -0,0 +1,105 @@
+#pragma once
+
+#include "utility/result.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+// Files made of a header, fixed-size tables stored back to back and a text
+// pool at the end, used in place from a memory mapping
+
+namespace imas {
+namespace utility {
+
+// Text in the pool
+struct PoolText {
+  uint32_t offset;
+  uint32_t size;
+};
+
+// Hands out the tables in the order they are stored. A table that doesn't
+// fit comes out empty and fails the reader.
+class TableReader {
+public:
+  TableReader(std::span<char const> data, size_t offset) : m_data(data), m_offset(offset) {}
+
+  template <class T>
+  std::span<T const> next(uint64_t count) {
+    if (m_failed || count > (m_data.size() - m_offset) / sizeof(T)) {
+      m_failed = true;
+      return {};
+    }
+    std::span const table(reinterpret_cast<T const *>(m_data.data() + m_offset), count);
+    m_offset += sizeof(T) * count;
+    return table;
+  }
+  std::string_view pool(uint64_t size) {
+    auto const bytes = next<char>(size);
+    return {bytes.data(), bytes.size()};
+  }
+  // Every table fit and nothing is left over
+  bool complete() const { return !m_failed && m_offset == m_data.size(); }
+
+private:
+  std::span<char const> m_data;
+  size_t m_offset;
+  bool m_failed = false;
+};
+
+inline bool rangeFits(uint64_t first, uint64_t count, size_t size) { return first + count <= size; }
+
+inline bool textFits(PoolText const &text, std::string_view pool) {
+  return rangeFits(text.offset, text.size, pool.size());
+}
+
+// Whether 'ranges' split [0, size) in order and without gaps, so the owner of
+// an item is the last range starting at or before it
+template <class Range, class Index, class Count>
+bool rangesCover(std::span<Range const> ranges, Index Range::*first, Count Range::*count, size_t size) {
+  uint64_t next = 0;
+  for (auto const &range : ranges) {
+    if (range.*first != next) {
+      return false;
+    }
+    next += range.*count;
+  }
+  return next == size;
+}
+
+template <class T>
+void writeTable(std::ostream &stream, std::vector<T> const &table) {
+  stream.write(reinterpret_cast<char const *>(table.data()), table.size() * sizeof(T));
+}
+
+// Writes the file under another name and moves it over 'path', since the
+// previous version may still be mapped
+template <class Write>
+file::Result replaceFile(std::filesystem::path const &path, Write &&write) {
+  auto temp_path = path;
+  temp_path += ".tmp";
+  {
+    std::ofstream stream(temp_path, std::ios_base::binary);
+    if (!stream.is_open()) {
+      return {false, "failed to create " + temp_path.string()};
+    }
+    write(stream);
+    if (!stream) {
+      return {false, "failed to write " + temp_path.string()};
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temp_path, path, ec);
+  if (ec) {
+    std::filesystem::remove(temp_path, ec);
+    return {false, "failed to replace " + path.string() + ", close whatever has it open"};
+  }
+  return {true, ""};
+}
+
+} // namespace utility
+} // namespace imas
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace imas {
+namespace utility {
+
+// Bytes that either view a buffer owned by someone else (usually the file
+// they were loaded from) or own a buffer of their own once rebuilt.
+// Copies of a viewing payload view the same bytes.
+class Payload {
+public:
+  Payload() = default;
+  Payload(Payload const& other)
+      : m_owned(other.m_owned), m_view(other.owned() ? std::span<char const>(m_owned) : other.m_view) {}
+  Payload& operator=(Payload const& other) {
+    if (this != &other) {
+      m_owned = other.m_owned;
+      m_view = other.owned() ? std::span<char const>(m_owned) : other.m_view;
+    }
+    return *this;
+  }
+  Payload(Payload&&) noexcept = default;
+  Payload& operator=(Payload&&) noexcept = default;
+
+  void view(std::span<char const> data) {
+    m_owned = {};
+    m_view = data;
+  }
+  void assign(std::vector<char>&& data) {
+    m_owned = std::move(data);
+    m_view = m_owned;
+  }
+  // Moves the owned buffer out, or copies the viewed bytes; leaves the payload empty
+  std::vector<char> take() {
+    auto result = owned() ? std::move(m_owned) : std::vector<char>(m_view.begin(), m_view.end());
+    m_owned = {};
+    m_view = {};
+    return result;
+  }
+
+  std::span<char const> span() const { return m_view; }
+  char const* data() const { return m_view.data(); }
+  size_t size() const { return m_view.size(); }
+
+private:
+  bool owned() const { return !m_owned.empty(); }
+
+  std::vector<char> m_owned;
+  std::span<char const> m_view;
+};
+
+} // namespace utility
+} // namespace imas
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <bit>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <istream>
+#include <span>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace imas {
@@ -20,6 +25,96 @@ inline void writeFromValue(std::basic_ostream<char> *stream, T value) {
   stream->write((char *)&value, sizeof(value));
 }
 
+// Big-endian value straight from a buffer
+template<class T>
+inline T loadValue(char const *data) {
+  T value;
+  std::memcpy(&value, data, sizeof(value));
+  return std::byteswap(value);
+}
+
+// Big-endian value straight into a buffer
+template<class T>
+inline void storeValue(char *data, T value) {
+  value = std::byteswap(value);
+  std::memcpy(data, &value, sizeof(value));
+}
+
+template<class T>
+inline void appendValue(std::vector<char> &buffer, T value) {
+  value = std::byteswap(value);
+  auto const bytes = reinterpret_cast<char const *>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+inline void appendPadding(std::vector<char> &buffer, char pad_char = 0, int pad_size = 0x10) {
+  buffer.resize((buffer.size() + pad_size - 1) / pad_size * pad_size, pad_char);
+}
+
+// Swaps every 32-bit word of 'data' between big-endian and native order.
+// Works on two words at a time with shifts and masks, which compilers turn
+// into SIMD code without needing byte shuffle instructions.
+inline void byteswapRange(std::span<std::byte> data) {
+  auto const count = data.size() / sizeof(uint64_t);
+  auto const bytes = data.data();
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t value;
+    std::memcpy(&value, bytes + i * sizeof(value), sizeof(value));
+    value = ((value & 0x00FF00FF00FF00FFull) << 8) | ((value >> 8) & 0x00FF00FF00FF00FFull);
+    value = ((value & 0x0000FFFF0000FFFFull) << 16) | ((value >> 16) & 0x0000FFFF0000FFFFull);
+    std::memcpy(bytes + i * sizeof(value), &value, sizeof(value));
+  }
+  if (data.size() % sizeof(uint64_t) >= sizeof(uint32_t)) {
+    auto const tail = bytes + count * sizeof(uint64_t);
+    uint32_t value;
+    std::memcpy(&value, tail, sizeof(value));
+    value = std::byteswap(value);
+    std::memcpy(tail, &value, sizeof(value));
+  }
+}
+
+// Same for 16-bit words, i.e. UTF-16 text
+inline void byteswapRange16(std::span<std::byte> data) {
+  auto const count = data.size() / sizeof(uint64_t);
+  auto const bytes = data.data();
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t value;
+    std::memcpy(&value, bytes + i * sizeof(value), sizeof(value));
+    value = ((value & 0x00FF00FF00FF00FFull) << 8) | ((value >> 8) & 0x00FF00FF00FF00FFull);
+    std::memcpy(bytes + i * sizeof(value), &value, sizeof(value));
+  }
+  for (auto tail = bytes + count * sizeof(uint64_t); tail + 1 < bytes + data.size(); tail += 2) {
+    std::swap(tail[0], tail[1]);
+  }
+}
+
+// Tables made of 32-bit fields, or strings of 16-bit characters, are read
+// and written as one block
+template<class T>
+inline void byteswapAs(std::span<std::byte> data) {
+  static_assert(std::is_trivially_copyable_v<T> &&
+                (sizeof(T) == sizeof(uint16_t) || 0 == sizeof(T) % sizeof(uint32_t)));
+  if constexpr (sizeof(T) == sizeof(uint16_t)) {
+    byteswapRange16(data);
+  } else {
+    byteswapRange(data);
+  }
+}
+
+template<class T>
+inline void readRange(std::basic_istream<char> *stream, std::span<T> values) {
+  stream->read(reinterpret_cast<char *>(values.data()), values.size_bytes());
+  byteswapAs<T>(std::as_writable_bytes(values));
+}
+
+template<class T>
+inline void appendRange(std::vector<char> &buffer, std::span<T const> values) {
+  auto const start = buffer.size();
+  buffer.resize(start + values.size_bytes());
+  std::memcpy(buffer.data() + start, values.data(), values.size_bytes());
+  byteswapAs<T>(std::as_writable_bytes(std::span(buffer).subspan(start)));
+}
+
 inline int32_t readLong(std::basic_istream<char> *stream) {
   int32_t value;
   stream->read((char *)&value, sizeof(value));
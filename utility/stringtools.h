@@ -1,9 +1,275 @@
 #ifndef STRINGTOOLS_H
 #define STRINGTOOLS_H
 
-#include <codecvt>
-#include <locale>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
 
-typedef std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> WidestringConv;
+namespace imas {
+namespace utility {
+
+namespace detail {
+// Reads 8 bytes as a little-endian word, so the lane layout is the same on
+// every host
+inline uint64_t loadLittle64(void const *data) {
+  uint64_t value;
+  std::memcpy(&value, data, sizeof(value));
+  if constexpr (std::endian::native == std::endian::big) {
+    value = std::byteswap(value);
+  }
+  return value;
+}
+
+inline char *putUtf8(char *out, char32_t code_point) {
+  if (code_point < 0x80) {
+    *out++ = char(code_point);
+  } else if (code_point < 0x800) {
+    *out++ = char(0xC0 | (code_point >> 6));
+    *out++ = char(0x80 | (code_point & 0x3F));
+  } else if (code_point < 0x10000) {
+    *out++ = char(0xE0 | (code_point >> 12));
+    *out++ = char(0x80 | ((code_point >> 6) & 0x3F));
+    *out++ = char(0x80 | (code_point & 0x3F));
+  } else {
+    *out++ = char(0xF0 | (code_point >> 18));
+    *out++ = char(0x80 | ((code_point >> 12) & 0x3F));
+    *out++ = char(0x80 | ((code_point >> 6) & 0x3F));
+    *out++ = char(0x80 | (code_point & 0x3F));
+  }
+  return out;
+}
+
+// Big-endian UTF-16 stored as bytes
+struct Utf16BESource {
+  char const *data;
+  char16_t unit(size_t pos) const {
+    return (uint8_t(data[pos * 2]) << 8) | uint8_t(data[pos * 2 + 1]);
+  }
+  // Four units at 'pos' are all below 0x80: high bytes zero, low bytes ASCII
+  bool ascii4(size_t pos) const {
+    return 0 == (loadLittle64(data + pos * 2) & 0x80FF80FF80FF80FFULL);
+  }
+  void copyAscii4(size_t pos, char *out) const {
+    auto const word = loadLittle64(data + pos * 2);
+    out[0] = char(word >> 8);
+    out[1] = char(word >> 24);
+    out[2] = char(word >> 40);
+    out[3] = char(word >> 56);
+  }
+};
+
+// UTF-16 in host order
+struct Utf16Source {
+  char16_t const *data;
+  char16_t unit(size_t pos) const { return data[pos]; }
+  bool ascii4(size_t pos) const {
+    uint64_t word;
+    std::memcpy(&word, data + pos, sizeof(word));
+    return 0 == (word & 0xFF80FF80FF80FF80ULL);
+  }
+  void copyAscii4(size_t pos, char *out) const {
+    for (int i = 0; i < 4; ++i) {
+      out[i] = char(data[pos + i]);
+    }
+  }
+};
+
+// Writes 'count' units from 'source' as UTF-8 and returns the end of the
+// output. 'out' must have room for count * 3 bytes. Unpaired surrogates
+// become U+FFFD.
+template <class Source>
+char *utf16ToUtf8(Source const &source, size_t count, char *out) {
+  size_t pos = 0;
+  while (pos < count) {
+    // Runs of ASCII go four units per step
+    while (pos + 4 <= count && source.ascii4(pos)) {
+      source.copyAscii4(pos, out);
+      out += 4;
+      pos += 4;
+    }
+    if (pos == count) {
+      break;
+    }
+    char32_t code_point = source.unit(pos++);
+    if (code_point >= 0xD800 && code_point < 0xDC00) {
+      if (pos < count && source.unit(pos) >= 0xDC00 && source.unit(pos) < 0xE000) {
+        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (source.unit(pos++) - 0xDC00);
+      } else {
+        code_point = 0xFFFD;
+      }
+    } else if (code_point >= 0xDC00 && code_point < 0xE000) {
+      code_point = 0xFFFD;
+    }
+    out = putUtf8(out, code_point);
+  }
+  return out;
+}
+
+// Number of big-endian units before the first zero one
+inline size_t utf16BELength(std::span<char const> data) {
+  auto const count = data.size() / 2;
+  size_t pos = 0;
+  // Zero lane test, see "Bit Twiddling Hacks". It may flag lanes above a real
+  // zero, so the hit block is rescanned unit by unit.
+  for (; pos + 4 <= count; pos += 4) {
+    auto const word = loadLittle64(data.data() + pos * 2);
+    if ((word - 0x0001000100010001ULL) & ~word & 0x8000800080008000ULL) {
+      break;
+    }
+  }
+  for (; pos < count; ++pos) {
+    if (0 == data[pos * 2] && 0 == data[pos * 2 + 1]) {
+      break;
+    }
+  }
+  return pos;
+}
+} // namespace detail
+
+inline void appendUtf8(std::string &output, char32_t code_point) {
+  char buffer[4];
+  output.append(buffer, detail::putUtf8(buffer, code_point));
+}
+
+// Appends big-endian UTF-16 as UTF-8, up to a zero character or the end of
+// 'data'. Unpaired surrogates become U+FFFD.
+inline void appendUtf8FromUtf16BE(std::string &output, std::span<char const> data) {
+  auto const count = detail::utf16BELength(data);
+  auto const start = output.size();
+  output.resize(start + count * 3);
+  auto const end = detail::utf16ToUtf8(detail::Utf16BESource{data.data()}, count, output.data() + start);
+  output.resize(end - output.data());
+}
+
+// Appends host order UTF-16 as UTF-8. Unpaired surrogates become U+FFFD.
+inline void appendUtf8FromUtf16(std::string &output, std::u16string_view input) {
+  auto const start = output.size();
+  output.resize(start + input.size() * 3);
+  auto const end = detail::utf16ToUtf8(detail::Utf16Source{input.data()}, input.size(), output.data() + start);
+  output.resize(end - output.data());
+}
+
+inline std::string toUtf8(std::u16string_view input) {
+  std::string output;
+  appendUtf8FromUtf16(output, input);
+  return output;
+}
+
+// Decodes one code point from the start of 'input' and drops it from there.
+// Malformed sequences give U+FFFD and skip a single byte.
+inline char32_t popUtf8(std::string_view &input) {
+  auto const lead = uint8_t(input[0]);
+  int length = 1;
+  char32_t code_point = lead;
+  if (lead >= 0xF0 && lead < 0xF5) {
+    length = 4;
+    code_point = lead & 0x07;
+  } else if (lead >= 0xE0) {
+    length = lead < 0xF0 ? 3 : 0;
+    code_point = lead & 0x0F;
+  } else if (lead >= 0xC2) {
+    length = 2;
+    code_point = lead & 0x1F;
+  } else if (lead >= 0x80) {
+    length = 0;
+  }
+  if (0 == length || input.size() < size_t(length)) {
+    input.remove_prefix(1);
+    return 0xFFFD;
+  }
+  for (int i = 1; i < length; ++i) {
+    auto const continuation = uint8_t(input[i]);
+    if ((continuation & 0xC0) != 0x80) {
+      input.remove_prefix(1);
+      return 0xFFFD;
+    }
+    code_point = (code_point << 6) | (continuation & 0x3F);
+  }
+  // Overlong forms, surrogates and values past U+10FFFF
+  static constexpr char32_t minimum[] = {0, 0, 0x80, 0x800, 0x10000};
+  if (code_point < minimum[length] || (code_point >= 0xD800 && code_point < 0xE000) || code_point > 0x10FFFF) {
+    input.remove_prefix(1);
+    return 0xFFFD;
+  }
+  input.remove_prefix(length);
+  return code_point;
+}
+
+namespace detail {
+// Decodes UTF-8 and hands every UTF-16 unit to 'put'. Pure ASCII blocks go to
+// 'put_ascii8' eight bytes at a time.
+template <class Put, class PutAscii8>
+void utf8ToUtf16(std::string_view input, Put &&put, PutAscii8 &&put_ascii8) {
+  while (!input.empty()) {
+    while (input.size() >= 8) {
+      auto const word = loadLittle64(input.data());
+      if (word & 0x8080808080808080ULL) {
+        break;
+      }
+      put_ascii8(word);
+      input.remove_prefix(8);
+    }
+    if (input.empty()) {
+      break;
+    }
+    auto const code_point = popUtf8(input);
+    if (code_point >= 0x10000) {
+      put(char16_t(0xD800 + ((code_point - 0x10000) >> 10)));
+      put(char16_t(0xDC00 + ((code_point - 0x10000) & 0x3FF)));
+    } else {
+      put(char16_t(code_point));
+    }
+  }
+}
+} // namespace detail
+
+// Appends UTF-8 text as big-endian UTF-16, without a terminator
+inline void appendUtf16BEFromUtf8(std::vector<char> &output, std::string_view input) {
+  auto const start = output.size();
+  // Every UTF-8 byte gives at most one UTF-16 unit
+  output.resize(start + input.size() * 2);
+  auto out = output.data() + start;
+  detail::utf8ToUtf16(
+      input,
+      [&out](char16_t unit) {
+        *out++ = char(unit >> 8);
+        *out++ = char(unit & 0xFF);
+      },
+      [&out](uint64_t word) {
+        for (int i = 0; i < 8; ++i, word >>= 8) {
+          *out++ = 0;
+          *out++ = char(word & 0xFF);
+        }
+      });
+  output.resize(out - output.data());
+}
+
+// Appends UTF-8 text as host order UTF-16
+inline void appendUtf16FromUtf8(std::u16string &output, std::string_view input) {
+  auto const start = output.size();
+  output.resize(start + input.size());
+  auto out = output.data() + start;
+  detail::utf8ToUtf16(
+      input, [&out](char16_t unit) { *out++ = unit; },
+      [&out](uint64_t word) {
+        for (int i = 0; i < 8; ++i, word >>= 8) {
+          *out++ = char16_t(word & 0xFF);
+        }
+      });
+  output.resize(out - output.data());
+}
+
+inline std::u16string toUtf16(std::string_view input) {
+  std::u16string output;
+  appendUtf16FromUtf8(output, input);
+  return output;
+}
+
+} // namespace utility
+} // namespace imas
 
 #endif // STRINGTOOLS_H
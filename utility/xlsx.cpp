@@ -0,0 +1,456 @@
+#include "xlsx.h"
+
+#include "utility/stringtools.h"
+#include "utility/xmlreader.h"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <optional>
+
+namespace {
+constexpr std::string_view content_types_xml =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+    "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+    "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+    "<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+    "<Override PartName=\"/xl/workbook.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.sheet.main+xml\"/>"
+    "<Override PartName=\"/xl/worksheets/sheet1.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.worksheet+xml\"/>"
+    "<Override PartName=\"/xl/styles.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.styles+xml\"/>"
+    "</Types>";
+
+constexpr std::string_view root_rels_xml =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+    "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+    "<Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument\" Target=\"xl/workbook.xml\"/>"
+    "</Relationships>";
+
+constexpr std::string_view workbook_xml =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+    "<workbook xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\" "
+    "xmlns:r=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships\">"
+    "<sheets><sheet name=\"Sheet1\" sheetId=\"1\" r:id=\"rId1\"/></sheets>"
+    "</workbook>";
+
+constexpr std::string_view workbook_rels_xml =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+    "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+    "<Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/worksheet\" Target=\"worksheets/sheet1.xml\"/>"
+    "<Relationship Id=\"rId2\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/styles\" Target=\"styles.xml\"/>"
+    "</Relationships>";
+
+// The least Excel accepts without complaining
+constexpr std::string_view styles_xml =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+    "<styleSheet xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\">"
+    "<fonts count=\"1\"><font><sz val=\"11\"/><name val=\"Calibri\"/></font></fonts>"
+    "<fills count=\"2\"><fill><patternFill patternType=\"none\"/></fill><fill><patternFill patternType=\"gray125\"/></fill></fills>"
+    "<borders count=\"1\"><border><left/><right/><top/><bottom/><diagonal/></border></borders>"
+    "<cellStyleXfs count=\"1\"><xf numFmtId=\"0\" fontId=\"0\" fillId=\"0\" borderId=\"0\"/></cellStyleXfs>"
+    "<cellXfs count=\"1\"><xf numFmtId=\"0\" fontId=\"0\" fillId=\"0\" borderId=\"0\" xfId=\"0\"/></cellXfs>"
+    "<cellStyles count=\"1\"><cellStyle name=\"Normal\" xfId=\"0\" builtinId=\"0\"/></cellStyles>"
+    "</styleSheet>";
+
+constexpr std::string_view sheet_header =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+    "<worksheet xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\"><sheetData>";
+constexpr std::string_view sheet_footer = "</sheetData></worksheet>";
+
+void appendColumnName(std::string &output, size_t column) {
+  char letters[4];
+  int count = 0;
+  for (++column; column > 0; column = (column - 1) / 26) {
+    letters[count++] = char('A' + (column - 1) % 26);
+  }
+  while (count > 0) {
+    output.push_back(letters[--count]);
+  }
+}
+
+bool isHex(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
+}
+
+bool isSpace(char c) { return ' ' == c || '\t' == c || '\n' == c; }
+
+int hexValue(char c) {
+  return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+// Parts may use a namespace prefix ("x:c") for the main namespace
+std::string_view localName(std::string_view name) {
+  auto const colon = name.find(':');
+  return std::string_view::npos == colon ? name : name.substr(colon + 1);
+}
+
+std::string_view findAttribute(std::span<imas::utility::XmlReader::Attribute const> attributes,
+                               std::string_view name) {
+  for (auto const &attribute : attributes) {
+    if (localName(attribute.name) == name) {
+      return attribute.value;
+    }
+  }
+  return {};
+}
+
+struct CellReference {
+  int column; // 0-based
+  int row;    // 1-based
+};
+
+// "AB12" form of the "r" attribute
+std::optional<CellReference> parseCellReference(std::string_view text) {
+  CellReference reference{-1, 0};
+  size_t i = 0;
+  for (; i < text.size() && text[i] >= 'A' && text[i] <= 'Z'; ++i) {
+    reference.column = (reference.column + 1) * 26 + (text[i] - 'A');
+  }
+  auto const [end, ec] = std::from_chars(text.data() + i, text.data() + text.size(), reference.row);
+  if (i == 0 || ec != std::errc{} || end != text.data() + text.size()) {
+    return {};
+  }
+  return reference;
+}
+
+std::optional<int> parseInt(std::string_view text) {
+  int value;
+  auto const [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc{} || end != text.data() + text.size()) {
+    return {};
+  }
+  return value;
+}
+
+// Reverses the "_xHHHH_" escapes, see XlsxWriter::appendEscaped
+void decodeEscapes(std::string &text) {
+  auto const escapeAt = [&](size_t i) -> int {
+    if (i + 6 < text.size() && '_' == text[i] && 'x' == text[i + 1] && '_' == text[i + 6] &&
+        isHex(text[i + 2]) && isHex(text[i + 3]) && isHex(text[i + 4]) && isHex(text[i + 5])) {
+      return (hexValue(text[i + 2]) << 12) | (hexValue(text[i + 3]) << 8) |
+             (hexValue(text[i + 4]) << 4) | hexValue(text[i + 5]);
+    }
+    return -1;
+  };
+  auto i = text.find("_x");
+  if (std::string::npos == i) {
+    return;
+  }
+  std::string decoded(text, 0, i);
+  while (i < text.size()) {
+    auto code_point = escapeAt(i);
+    if (code_point < 0) {
+      decoded.push_back(text[i++]);
+      continue;
+    }
+    i += 7;
+    // Characters outside the BMP come as a surrogate pair of escapes
+    if (code_point >= 0xD800 && code_point < 0xDC00) {
+      auto const low = escapeAt(i);
+      if (low >= 0xDC00 && low < 0xE000) {
+        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+        i += 7;
+      }
+    }
+    imas::utility::appendUtf8(decoded, char32_t(code_point));
+  }
+  text = std::move(decoded);
+}
+} // namespace
+
+namespace imas {
+namespace utility {
+
+XlsxWriter::XlsxWriter() { m_sheet = sheet_header; }
+
+void XlsxWriter::addRow(std::span<std::string_view const> cells) {
+  ++m_row;
+  auto const row = std::to_string(m_row);
+  bool open = false;
+  for (size_t column = 0; column < cells.size(); ++column) {
+    auto const text = cells[column];
+    if (text.empty()) {
+      continue;
+    }
+    if (!open) {
+      m_sheet += "<row r=\"";
+      m_sheet += row;
+      m_sheet += "\">";
+      open = true;
+    }
+    m_sheet += "<c r=\"";
+    appendColumnName(m_sheet, column);
+    m_sheet += row;
+    m_sheet += isSpace(text.front()) || isSpace(text.back())
+                   ? "\" t=\"inlineStr\"><is><t xml:space=\"preserve\">"
+                   : "\" t=\"inlineStr\"><is><t>";
+    appendEscaped(text);
+    m_sheet += "</t></is></c>";
+  }
+  if (open) {
+    m_sheet += "</row>";
+  }
+}
+
+// XML escaping plus the OOXML "_xHHHH_" form for characters XML can't hold.
+// A literal "_xHHHH_" gets its underscore escaped, or Excel would decode it.
+void XlsxWriter::appendEscaped(std::string_view text) {
+  static constexpr char hex[] = "0123456789ABCDEF";
+  for (size_t i = 0; i < text.size(); ++i) {
+    auto const c = text[i];
+    switch (c) {
+    case '&':
+      m_sheet += "&amp;";
+      continue;
+    case '<':
+      m_sheet += "&lt;";
+      continue;
+    case '>':
+      m_sheet += "&gt;";
+      continue;
+    case '\t':
+    case '\n':
+      m_sheet += c;
+      continue;
+    case '_':
+      if (i + 6 < text.size() && 'x' == text[i + 1] && '_' == text[i + 6] &&
+          isHex(text[i + 2]) && isHex(text[i + 3]) && isHex(text[i + 4]) && isHex(text[i + 5])) {
+        m_sheet += "_x005F_";
+      } else {
+        m_sheet += c;
+      }
+      continue;
+    default:
+      break;
+    }
+    if (uint8_t(c) < 0x20) {
+      m_sheet += "_x00";
+      m_sheet += hex[uint8_t(c) >> 4];
+      m_sheet += hex[c & 0xF];
+      m_sheet += '_';
+    } else {
+      m_sheet += c;
+    }
+  }
+}
+
+std::vector<char> XlsxWriter::finish() {
+  m_sheet += sheet_footer;
+  ZipWriter zip;
+  zip.addFile("[Content_Types].xml", content_types_xml);
+  zip.addFile("_rels/.rels", root_rels_xml);
+  zip.addFile("xl/workbook.xml", workbook_xml);
+  zip.addFile("xl/_rels/workbook.xml.rels", workbook_rels_xml);
+  zip.addFile("xl/styles.xml", styles_xml);
+  zip.addFile("xl/worksheets/sheet1.xml", m_sheet);
+  m_sheet = sheet_header;
+  m_row = 0;
+  return zip.finish();
+}
+
+file::Result XlsxWriter::save(std::filesystem::path const &path) {
+  auto const archive = finish();
+  std::ofstream stream(path, std::ios_base::binary);
+  if (!stream.is_open()) {
+    return {false, "failed to create " + path.string()};
+  }
+  stream.write(archive.data(), archive.size());
+  if (!stream) {
+    return {false, "failed to write " + path.string()};
+  }
+  return {true, ""};
+}
+
+file::Result XlsxReader::open(std::filesystem::path const &path) {
+  std::ifstream stream(path, std::ios_base::binary);
+  if (!stream.is_open()) {
+    return {false, "failed to open " + path.string()};
+  }
+  std::error_code ec;
+  auto const size = std::filesystem::file_size(path, ec);
+  if (ec) {
+    return {false, "failed to read " + path.string()};
+  }
+  m_archive.resize(size);
+  stream.read(m_archive.data(), m_archive.size());
+  if (!stream) {
+    return {false, "failed to read " + path.string()};
+  }
+  if (!m_zip.open(m_archive)) {
+    return {false, path.string() + " is not a workbook"};
+  }
+  return {true, ""};
+}
+
+file::Result XlsxReader::readColumn(
+    int column, std::function<void(int row, std::string_view text)> const &callback) const {
+  return readColumns(std::span(&column, 1),
+                     [&](int row, int, std::string_view text) { callback(row, text); });
+}
+
+file::Result XlsxReader::readColumns(
+    std::span<int const> columns,
+    std::function<void(int row, int column, std::string_view text)> const &callback) const {
+  // Where Excel, LibreOffice and openpyxl put the first sheet
+  auto const sheet = m_zip.read("xl/worksheets/sheet1.xml");
+  if (!sheet) {
+    return {false, "failed to unpack the first sheet"};
+  }
+  struct Cell {
+    int row;
+    int column;
+    int shared; // index into the shared strings, -1 if the text is inline
+    std::string text;
+  };
+  std::vector<Cell> cells;
+
+  XmlReader reader({sheet->data(), sheet->size()}, true);
+  int row = 0;
+  int next_column = 0;
+  int cell_column = 0;
+  bool in_cell = false;
+  bool shared = false;
+  std::string text;
+  // Text of <v>, or of <t> outside of phonetic runs
+  bool collecting = false;
+  int phonetic_depth = 0;
+  for (auto event = reader.next(); event != XmlReader::Event::end_document; event = reader.next()) {
+    switch (event) {
+    case XmlReader::Event::error:
+      return {false, "sheet: " + reader.error()};
+    case XmlReader::Event::start_element: {
+      auto const name = localName(reader.name());
+      if ("row" == name) {
+        row = parseInt(findAttribute(reader.attributes(), "r")).value_or(row + 1);
+        next_column = 0;
+      } else if ("c" == name) {
+        // Excel writes references, others may leave them out for dense rows
+        cell_column = next_column;
+        if (auto const reference = parseCellReference(findAttribute(reader.attributes(), "r"))) {
+          cell_column = reference->column;
+          row = reference->row;
+        }
+        next_column = cell_column + 1;
+        in_cell = std::ranges::find(columns, cell_column) != columns.end();
+        shared = "s" == findAttribute(reader.attributes(), "t");
+        text.clear();
+        collecting = false;
+        phonetic_depth = 0;
+      } else if (in_cell && ("v" == name || ("t" == name && 0 == phonetic_depth))) {
+        collecting = true;
+      } else if ("rPh" == name) {
+        ++phonetic_depth;
+      }
+      break;
+    }
+    case XmlReader::Event::end_element: {
+      auto const name = localName(reader.name());
+      if ("v" == name || "t" == name) {
+        collecting = false;
+      } else if ("rPh" == name) {
+        --phonetic_depth;
+      } else if ("c" == name && in_cell) {
+        in_cell = false;
+        if (!shared) {
+          cells.push_back({row, cell_column, -1, std::move(text)});
+        } else if (auto const index = parseInt(text); index && *index >= 0) {
+          cells.push_back({row, cell_column, *index, {}});
+        } else {
+          return {false, "sheet: broken shared string index \"" + text + "\""};
+        }
+      }
+      break;
+    }
+    case XmlReader::Event::text:
+      if (collecting) {
+        text += reader.text();
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Decode only the shared strings the column refers to
+  std::vector<int> needed;
+  for (auto const &cell : cells) {
+    if (cell.shared >= 0) {
+      needed.push_back(cell.shared);
+    }
+  }
+  std::ranges::sort(needed);
+  needed.erase(std::ranges::unique(needed).begin(), needed.end());
+  std::vector<std::string> shared_strings(needed.size());
+  if (!needed.empty()) {
+    auto const table = m_zip.read("xl/sharedStrings.xml");
+    if (!table) {
+      return {false, "failed to unpack the shared strings"};
+    }
+    XmlReader reader({table->data(), table->size()}, true);
+    int index = -1;
+    auto pending = needed.begin();
+    std::string *target = nullptr;
+    bool collecting = false;
+    int phonetic_depth = 0;
+    for (auto event = reader.next();
+         event != XmlReader::Event::end_document && pending != needed.end(); event = reader.next()) {
+      switch (event) {
+      case XmlReader::Event::error:
+        return {false, "shared strings: " + reader.error()};
+      case XmlReader::Event::start_element: {
+        auto const name = localName(reader.name());
+        if ("si" == name) {
+          ++index;
+          target = *pending == index ? &shared_strings[pending - needed.begin()] : nullptr;
+          collecting = false;
+          phonetic_depth = 0;
+        } else if (target && "t" == name && 0 == phonetic_depth) {
+          collecting = true;
+        } else if ("rPh" == name) {
+          ++phonetic_depth;
+        }
+        break;
+      }
+      case XmlReader::Event::end_element: {
+        auto const name = localName(reader.name());
+        if ("t" == name) {
+          collecting = false;
+        } else if ("rPh" == name) {
+          --phonetic_depth;
+        } else if ("si" == name && target) {
+          target = nullptr;
+          ++pending;
+        }
+        break;
+      }
+      case XmlReader::Event::text:
+        if (collecting) {
+          *target += reader.text();
+        }
+        break;
+      default:
+        break;
+      }
+    }
+    if (pending != needed.end()) {
+      return {false, "shared strings: index " + std::to_string(*pending) + " is missing"};
+    }
+  }
+
+  // Shared strings may be used by several cells, so they are decoded up front
+  std::ranges::for_each(shared_strings, decodeEscapes);
+  for (auto &cell : cells) {
+    if (cell.shared < 0) {
+      decodeEscapes(cell.text);
+    }
+    auto const &value =
+        cell.shared < 0 ? cell.text
+                        : shared_strings[std::ranges::lower_bound(needed, cell.shared) - needed.begin()];
+    if (!value.empty()) {
+      callback(cell.row, cell.column, value);
+    }
+  }
+  return {true, ""};
+}
+
+} // namespace utility
+} // namespace imas
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "utility/result.h"
+#include "utility/zip.h"
+
+#include <filesystem>
+#include <functional>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace imas {
+namespace utility {
+
+// Single sheet workbook of text cells, written row by row without a DOM.
+// Cells are inline strings, so no shared string table has to be kept.
+class XlsxWriter {
+public:
+  XlsxWriter();
+
+  // Cells go to columns A, B, ... in order, empty ones are left out
+  void addRow(std::span<std::string_view const> cells);
+  void addRow(std::initializer_list<std::string_view> cells) {
+    addRow(std::span(cells.begin(), cells.size()));
+  }
+  // Zips the workbook; the writer is empty afterwards
+  std::vector<char> finish();
+  file::Result save(std::filesystem::path const &path);
+
+private:
+  void appendEscaped(std::string_view text);
+
+  std::string m_sheet;
+  int m_row = 0;
+};
+
+// Reads text cells of the first sheet without building a DOM. Only the sheet
+// and the shared string table are unpacked, both are scanned as a stream of
+// XML events, and shared strings are decoded only for the cells asked for.
+class XlsxReader {
+public:
+  file::Result open(std::filesystem::path const &path);
+  // Hands the non-empty cells of 'column' (0 for A) to 'callback' in sheet
+  // order, with their 1-based row. Numbers come as Excel stored them.
+  file::Result readColumn(int column,
+                          std::function<void(int row, std::string_view text)> const &callback) const;
+  // Several columns in one pass; cells still come in sheet order
+  file::Result readColumns(
+      std::span<int const> columns,
+      std::function<void(int row, int column, std::string_view text)> const &callback) const;
+
+private:
+  std::vector<char> m_archive;
+  ZipReader m_zip;
+};
+
+} // namespace utility
+} // namespace imas
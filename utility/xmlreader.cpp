@@ -0,0 +1,262 @@
+#include "xmlreader.h"
+
+#include "utility/stringtools.h"
+
+#include <algorithm>
+#include <charconv>
+
+namespace {
+bool isSpace(char character) {
+  return ' ' == character || '\t' == character || '\n' == character || '\r' == character;
+}
+
+bool isNameEnd(char character) {
+  return isSpace(character) || '/' == character || '>' == character || '=' == character;
+}
+
+// &lt; &gt; &amp; &quot; &apos; and numeric references. Unknown ones are kept as is.
+size_t decodeEntity(std::string_view raw, std::string &output) {
+  auto const end = raw.find(';');
+  if (std::string_view::npos == end) {
+    return 0;
+  }
+  auto const entity = raw.substr(1, end - 1);
+  if ("lt" == entity) {
+    output.push_back('<');
+  } else if ("gt" == entity) {
+    output.push_back('>');
+  } else if ("amp" == entity) {
+    output.push_back('&');
+  } else if ("quot" == entity) {
+    output.push_back('"');
+  } else if ("apos" == entity) {
+    output.push_back('\'');
+  } else if (entity.size() > 1 && '#' == entity[0]) {
+    auto const hex = 'x' == entity[1];
+    auto const digits = entity.substr(hex ? 2 : 1);
+    uint32_t code_point = 0;
+    auto const [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), code_point, hex ? 16 : 10);
+    if (ec != std::errc{} || ptr != digits.data() + digits.size() || code_point > 0x10FFFF) {
+      return 0;
+    }
+    imas::utility::appendUtf8(output, code_point);
+  } else {
+    return 0;
+  }
+  return end + 1;
+}
+} // namespace
+
+namespace imas {
+namespace utility {
+
+XmlReader::XmlReader(std::string_view document, bool keep_whitespace)
+    : m_document(document), m_keep_whitespace(keep_whitespace) {
+  // UTF-8 BOM
+  if (m_document.starts_with("\xEF\xBB\xBF")) {
+    m_pos = 3;
+  }
+}
+
+XmlReader::Event XmlReader::next() {
+  if (m_close_pending) {
+    m_close_pending = false;
+    m_open_elements.pop_back();
+    return Event::end_element;
+  }
+  while (m_pos < m_document.size()) {
+    if ('<' != m_document[m_pos]) {
+      if (auto const event = readText()) {
+        return *event;
+      }
+      continue;
+    }
+    auto const rest = m_document.substr(m_pos);
+    if (rest.starts_with("<?")) {
+      if (!skipUntil("?>")) {
+        return fail("unterminated processing instruction");
+      }
+    } else if (rest.starts_with("<!--")) {
+      if (!skipUntil("-->")) {
+        return fail("unterminated comment");
+      }
+    } else if (rest.starts_with("<![CDATA[")) {
+      auto const end = rest.find("]]>");
+      if (std::string_view::npos == end) {
+        return fail("unterminated CDATA section");
+      }
+      m_text = rest.substr(9, end - 9);
+      m_pos += end + 3;
+      return Event::text;
+    } else if (rest.starts_with("<!")) {
+      if (!skipUntil(">")) {
+        return fail("unterminated declaration");
+      }
+    } else {
+      return readTag();
+    }
+  }
+  if (!m_open_elements.empty()) {
+    return fail("unexpected end of document, <" + std::string(m_open_elements.back()) + "> is not closed");
+  }
+  return Event::end_document;
+}
+
+XmlReader::Event XmlReader::fail(std::string message) {
+  m_error = std::move(message);
+  m_pos = m_document.size();
+  m_open_elements.clear();
+  return Event::error;
+}
+
+XmlReader::Event XmlReader::readTag() {
+  ++m_pos; // '<'
+  if (m_pos < m_document.size() && '/' == m_document[m_pos]) {
+    ++m_pos;
+    m_name = readName();
+    skipSpace();
+    if (m_pos >= m_document.size() || '>' != m_document[m_pos]) {
+      return fail("malformed end tag");
+    }
+    ++m_pos;
+    if (m_open_elements.empty() || m_open_elements.back() != m_name) {
+      return fail("unexpected end tag </" + std::string(m_name) + ">");
+    }
+    m_open_elements.pop_back();
+    return Event::end_element;
+  }
+
+  m_name = readName();
+  if (m_name.empty()) {
+    return fail("malformed start tag");
+  }
+  m_attributes.clear();
+  m_decoded.clear();
+  // Decoded values are collected first and bound afterwards, m_decoded may grow in between
+  std::vector<std::pair<size_t, size_t>> decoded_values;
+  while (true) {
+    skipSpace();
+    if (m_pos >= m_document.size()) {
+      return fail("unterminated start tag <" + std::string(m_name) + ">");
+    }
+    if ('>' == m_document[m_pos]) {
+      ++m_pos;
+      break;
+    }
+    if (m_document.substr(m_pos).starts_with("/>")) {
+      m_pos += 2;
+      m_close_pending = true;
+      break;
+    }
+    auto const attr_name = readName();
+    skipSpace();
+    if (attr_name.empty() || m_pos >= m_document.size() || '=' != m_document[m_pos]) {
+      return fail("malformed attribute in <" + std::string(m_name) + ">");
+    }
+    ++m_pos;
+    skipSpace();
+    if (m_pos >= m_document.size() || ('"' != m_document[m_pos] && '\'' != m_document[m_pos])) {
+      return fail("unquoted attribute value in <" + std::string(m_name) + ">");
+    }
+    auto const quote = m_document[m_pos++];
+    auto const end = m_document.find(quote, m_pos);
+    if (std::string_view::npos == end) {
+      return fail("unterminated attribute value in <" + std::string(m_name) + ">");
+    }
+    auto const raw = m_document.substr(m_pos, end - m_pos);
+    m_pos = end + 1;
+    auto const start = m_decoded.size();
+    if (auto const decoded = unescape(raw, true); std::string_view::npos != decoded) {
+      decoded_values.emplace_back(m_attributes.size(), start);
+    }
+    m_attributes.push_back({attr_name, raw});
+  }
+  for (size_t i = 0; i < decoded_values.size(); ++i) {
+    auto const [index, start] = decoded_values[i];
+    auto const end = i + 1 < decoded_values.size() ? decoded_values[i + 1].second : m_decoded.size();
+    m_attributes[index].value = std::string_view(m_decoded).substr(start, end - start);
+  }
+  m_open_elements.push_back(m_name);
+  return Event::start_element;
+}
+
+std::optional<XmlReader::Event> XmlReader::readText() {
+  auto end = m_document.find('<', m_pos);
+  if (std::string_view::npos == end) {
+    end = m_document.size();
+  }
+  auto const raw = m_document.substr(m_pos, end - m_pos);
+  m_pos = end;
+  if ((!m_keep_whitespace || m_open_elements.empty()) && std::ranges::all_of(raw, isSpace)) {
+    return {};
+  }
+  if (m_open_elements.empty()) {
+    return fail("text outside of the root element");
+  }
+  m_decoded.clear();
+  if (auto const decoded = unescape(raw, false); std::string_view::npos != decoded) {
+    m_text = m_decoded;
+  } else {
+    m_text = raw;
+  }
+  return Event::text;
+}
+
+bool XmlReader::skipUntil(std::string_view terminator) {
+  auto const end = m_document.find(terminator, m_pos);
+  if (std::string_view::npos == end) {
+    return false;
+  }
+  m_pos = end + terminator.size();
+  return true;
+}
+
+std::string_view XmlReader::readName() {
+  auto const start = m_pos;
+  while (m_pos < m_document.size() && !isNameEnd(m_document[m_pos])) {
+    ++m_pos;
+  }
+  return m_document.substr(start, m_pos - start);
+}
+
+void XmlReader::skipSpace() {
+  while (m_pos < m_document.size() && isSpace(m_document[m_pos])) {
+    ++m_pos;
+  }
+}
+
+size_t XmlReader::unescape(std::string_view raw, bool attribute) {
+  auto const special = [attribute](char character) {
+    return '&' == character || '\r' == character || (attribute && isSpace(character) && ' ' != character);
+  };
+  auto const first = std::ranges::find_if(raw, special);
+  if (first == raw.end()) {
+    return std::string_view::npos;
+  }
+  auto const start = m_decoded.size();
+  m_decoded.append(raw.begin(), first);
+  for (auto pos = size_t(first - raw.begin()); pos < raw.size(); ++pos) {
+    auto const character = raw[pos];
+    if ('&' == character) {
+      if (auto const length = decodeEntity(raw.substr(pos), m_decoded)) {
+        pos += length - 1;
+        continue;
+      }
+      m_decoded.push_back(character);
+    } else if ('\r' == character) {
+      // \r\n and lone \r both end a line
+      if (pos + 1 < raw.size() && '\n' == raw[pos + 1]) {
+        ++pos;
+      }
+      m_decoded.push_back(attribute ? ' ' : '\n');
+    } else if (attribute && isSpace(character)) {
+      m_decoded.push_back(' ');
+    } else {
+      m_decoded.push_back(character);
+    }
+  }
+  return start;
+}
+
+} // namespace utility
+} // namespace imas
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace imas {
+namespace utility {
+
+// Pull parser over an XML document kept in memory (or mapped). Reports one
+// event at a time, so nothing but the current tag is kept around. Strings
+// point into the document unless they had to be unescaped; either way they
+// are valid until the next call to next().
+// Follows pugixml's default parsing: whitespace-only text is skipped, line
+// ends are normalized, raw whitespace in attribute values becomes spaces.
+// With 'keep_whitespace', whitespace-only text inside the root is reported.
+class XmlReader {
+public:
+  enum class Event { start_element, end_element, text, end_document, error };
+  struct Attribute {
+    std::string_view name;
+    std::string_view value;
+  };
+
+  explicit XmlReader(std::string_view document, bool keep_whitespace = false);
+
+  Event next();
+  // Element name for start_element and end_element
+  std::string_view name() const { return m_name; }
+  std::span<Attribute const> attributes() const { return m_attributes; }
+  std::string_view text() const { return m_text; }
+  std::string const &error() const { return m_error; }
+  size_t position() const { return m_pos; }
+
+private:
+  Event fail(std::string message);
+  Event readTag();
+  // Nothing for whitespace-only text
+  std::optional<Event> readText();
+  bool skipUntil(std::string_view terminator);
+  std::string_view readName();
+  void skipSpace();
+  // Decodes into m_decoded when needed; returns the start of the decoded text there or npos
+  size_t unescape(std::string_view raw, bool attribute);
+
+  std::string_view m_document;
+  size_t m_pos = 0;
+  std::string_view m_name;
+  std::string_view m_text;
+  std::vector<Attribute> m_attributes;
+  std::vector<std::string_view> m_open_elements;
+  std::string m_decoded;
+  std::string m_error;
+  bool m_keep_whitespace = false;
+  bool m_close_pending = false; // "<tag/>" reports start_element, then end_element
+};
+
+} // namespace utility
+} // namespace imas
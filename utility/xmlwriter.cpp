@@ -0,0 +1,162 @@
+#include "xmlwriter.h"
+
+#include <array>
+#include <cstdint>
+
+namespace {
+constexpr size_t buffer_size = 64 * 1024;
+
+enum CharClass : uint8_t { special_text = 1, special_attribute = 2 };
+
+// Same character classes pugixml escapes in text and in attribute values
+constexpr auto char_classes = [] {
+  std::array<uint8_t, 256> table{};
+  for (int c = 0; c < 32; ++c) {
+    table[c] = special_text | special_attribute;
+  }
+  table['\t'] = table['\n'] = table['\r'] = special_attribute;
+  table['&'] = table['<'] = table['>'] = special_text | special_attribute;
+  table['"'] = special_attribute;
+  return table;
+}();
+} // namespace
+
+namespace imas {
+namespace utility {
+
+XmlWriter::XmlWriter(std::ostream &stream) : m_stream(stream) {
+  m_buffer.reserve(buffer_size);
+}
+
+XmlWriter::~XmlWriter() { flush(); }
+
+void XmlWriter::declaration() { write("<?xml version=\"1.0\"?>\n"); }
+
+void XmlWriter::startElement(std::string_view name) {
+  closeStartTag();
+  if (!m_empty) {
+    put('\n');
+  }
+  indent(m_open_elements.size());
+  put('<');
+  write(name);
+  m_open_elements.push_back(name);
+  m_start_tag_open = true;
+  m_empty = false;
+}
+
+void XmlWriter::attribute(std::string_view name, std::string_view value) {
+  put(' ');
+  write(name);
+  write("=\"");
+  escaped(value, true);
+  put('"');
+}
+
+void XmlWriter::textElement(std::string_view name, std::string_view text) {
+  closeStartTag();
+  put('\n');
+  indent(m_open_elements.size());
+  put('<');
+  write(name);
+  put('>');
+  escaped(text, false);
+  write("</");
+  write(name);
+  put('>');
+}
+
+void XmlWriter::endElement() {
+  auto const name = m_open_elements.back();
+  m_open_elements.pop_back();
+  if (m_start_tag_open) {
+    write(" />");
+    m_start_tag_open = false;
+    return;
+  }
+  put('\n');
+  indent(m_open_elements.size());
+  write("</");
+  write(name);
+  put('>');
+}
+
+void XmlWriter::finish() {
+  if (!m_empty) {
+    put('\n');
+  }
+  flush();
+  m_stream.flush();
+}
+
+void XmlWriter::closeStartTag() {
+  if (m_start_tag_open) {
+    put('>');
+    m_start_tag_open = false;
+  }
+}
+
+void XmlWriter::indent(size_t depth) {
+  for (size_t i = 0; i < depth; ++i) {
+    put('\t');
+  }
+}
+
+void XmlWriter::escaped(std::string_view text, bool attribute) {
+  auto const mask = attribute ? special_attribute : special_text;
+  size_t plain = 0;
+  for (size_t i = 0; i < text.size(); ++i) {
+    auto const character = uint8_t(text[i]);
+    if (!(char_classes[character] & mask)) {
+      continue;
+    }
+    write(text.substr(plain, i - plain));
+    plain = i + 1;
+    switch (character) {
+    case '&':
+      write("&amp;");
+      break;
+    case '<':
+      write("&lt;");
+      break;
+    case '>':
+      write("&gt;");
+      break;
+    case '"':
+      write("&quot;");
+      break;
+    default:
+      write("&#");
+      put(char('0' + character / 10));
+      put(char('0' + character % 10));
+      put(';');
+    }
+  }
+  write(text.substr(plain));
+}
+
+void XmlWriter::write(std::string_view text) {
+  if (m_buffer.size() + text.size() > buffer_size) {
+    flush();
+    if (text.size() > buffer_size) {
+      m_stream.write(text.data(), text.size());
+      return;
+    }
+  }
+  m_buffer.insert(m_buffer.end(), text.begin(), text.end());
+}
+
+void XmlWriter::put(char character) {
+  if (m_buffer.size() == buffer_size) {
+    flush();
+  }
+  m_buffer.push_back(character);
+}
+
+void XmlWriter::flush() {
+  m_stream.write(m_buffer.data(), m_buffer.size());
+  m_buffer.clear();
+}
+
+} // namespace utility
+} // namespace imas
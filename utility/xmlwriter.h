@@ -0,0 +1,44 @@
+#pragma once
+
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace imas {
+namespace utility {
+
+// Buffered XML serializer. Produces the same text as pugixml's default
+// save_file(): tab indentation, "<tag />" for empty elements and text-only
+// elements kept on one line.
+class XmlWriter {
+public:
+  explicit XmlWriter(std::ostream &stream);
+  ~XmlWriter();
+
+  void declaration();
+  // Names must stay alive until the matching endElement()
+  void startElement(std::string_view name);
+  void attribute(std::string_view name, std::string_view value);
+  // <name>text</name> as a child of the current element
+  void textElement(std::string_view name, std::string_view text);
+  void endElement();
+  // Writes the final line break and flushes the buffer
+  void finish();
+
+private:
+  void closeStartTag();
+  void indent(size_t depth);
+  void escaped(std::string_view text, bool attribute);
+  void write(std::string_view text);
+  void put(char character);
+  void flush();
+
+  std::ostream &m_stream;
+  std::vector<char> m_buffer;
+  std::vector<std::string_view> m_open_elements;
+  bool m_start_tag_open = false;
+  bool m_empty = true;
+};
+
+} // namespace utility
+} // namespace imas
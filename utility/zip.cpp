@@ -0,0 +1,204 @@
+#include "zip.h"
+
+#include "utility/compression.h"
+
+#include <algorithm>
+
+#include <zlib.h>
+
+namespace {
+constexpr uint32_t local_header_signature = 0x04034b50;
+constexpr uint32_t central_header_signature = 0x02014b50;
+constexpr uint32_t end_signature = 0x06054b50;
+constexpr uint16_t zip_version = 20;
+constexpr size_t local_header_size = 30;
+constexpr size_t central_header_size = 46;
+constexpr size_t end_record_size = 22;
+constexpr uint16_t method_store = 0;
+constexpr uint16_t method_deflate = 8;
+constexpr uint16_t dos_time = 0;
+constexpr uint16_t dos_date = (1 << 5) | 1; // 1980-01-01
+// Far above any workbook part, the directory's sizes aren't trusted past it
+constexpr uint32_t max_entry_size = 1 << 30;
+
+// ZIP fields are little-endian
+template <class T>
+void appendLittle(std::vector<char> &buffer, T value) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    buffer.push_back(char(value >> (i * 8)));
+  }
+}
+template <class T>
+T loadLittle(char const *data) {
+  T value = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    value |= T(uint8_t(data[i])) << (i * 8);
+  }
+  return value;
+}
+} // namespace
+
+namespace imas {
+namespace utility {
+
+void ZipWriter::addFile(std::string_view name, std::span<char const> data, bool compress) {
+  Entry entry{.name = std::string(name),
+              .crc = uint32_t(crc32(0, reinterpret_cast<Bytef const *>(data.data()), data.size())),
+              .compressed_size = uint32_t(data.size()),
+              .size = uint32_t(data.size()),
+              .offset = uint32_t(m_archive.size()),
+              .method = method_store};
+  std::vector<char> compressed;
+  if (compress) {
+    compressed = deflate(data, DeflateFormat::raw);
+    // Tiny or incompressible parts are cheaper stored
+    if (compressed.size() < data.size()) {
+      entry.method = method_deflate;
+      entry.compressed_size = compressed.size();
+      data = compressed;
+    }
+  }
+  appendLittle(m_archive, local_header_signature);
+  appendLittle(m_archive, zip_version);
+  appendLittle(m_archive, uint16_t(0)); // flags
+  appendLittle(m_archive, entry.method);
+  appendLittle(m_archive, dos_time);
+  appendLittle(m_archive, dos_date);
+  appendLittle(m_archive, entry.crc);
+  appendLittle(m_archive, entry.compressed_size);
+  appendLittle(m_archive, entry.size);
+  appendLittle(m_archive, uint16_t(entry.name.size()));
+  appendLittle(m_archive, uint16_t(0)); // extra field length
+  m_archive.insert(m_archive.end(), entry.name.begin(), entry.name.end());
+  m_archive.insert(m_archive.end(), data.begin(), data.end());
+  m_entries.push_back(std::move(entry));
+}
+
+std::vector<char> ZipWriter::finish() {
+  uint32_t const directory_offset = m_archive.size();
+  for (auto const &entry : m_entries) {
+    appendLittle(m_archive, central_header_signature);
+    appendLittle(m_archive, zip_version); // made by
+    appendLittle(m_archive, zip_version); // needed
+    appendLittle(m_archive, uint16_t(0)); // flags
+    appendLittle(m_archive, entry.method);
+    appendLittle(m_archive, dos_time);
+    appendLittle(m_archive, dos_date);
+    appendLittle(m_archive, entry.crc);
+    appendLittle(m_archive, entry.compressed_size);
+    appendLittle(m_archive, entry.size);
+    appendLittle(m_archive, uint16_t(entry.name.size()));
+    appendLittle(m_archive, uint16_t(0)); // extra field length
+    appendLittle(m_archive, uint16_t(0)); // comment length
+    appendLittle(m_archive, uint16_t(0)); // disk number
+    appendLittle(m_archive, uint16_t(0)); // internal attributes
+    appendLittle(m_archive, uint32_t(0)); // external attributes
+    appendLittle(m_archive, entry.offset);
+    m_archive.insert(m_archive.end(), entry.name.begin(), entry.name.end());
+  }
+  uint32_t const directory_size = m_archive.size() - directory_offset;
+  appendLittle(m_archive, end_signature);
+  appendLittle(m_archive, uint16_t(0)); // disk number
+  appendLittle(m_archive, uint16_t(0)); // disk with the directory
+  appendLittle(m_archive, uint16_t(m_entries.size()));
+  appendLittle(m_archive, uint16_t(m_entries.size()));
+  appendLittle(m_archive, directory_size);
+  appendLittle(m_archive, directory_offset);
+  appendLittle(m_archive, uint16_t(0)); // comment length
+  m_entries.clear();
+  return std::move(m_archive);
+}
+
+bool ZipReader::open(std::span<char const> archive) {
+  m_archive = archive;
+  m_entries.clear();
+  if (archive.size() < end_record_size) {
+    return false;
+  }
+  // The end record sits behind an optional comment of up to 64K
+  auto const search_start = archive.size() - std::min(archive.size(), end_record_size + 0xFFFF);
+  auto end = archive.size() - end_record_size;
+  while (loadLittle<uint32_t>(archive.data() + end) != end_signature) {
+    if (end == search_start) {
+      return false;
+    }
+    --end;
+  }
+  auto const count = loadLittle<uint16_t>(archive.data() + end + 10);
+  auto const directory_size = loadLittle<uint32_t>(archive.data() + end + 12);
+  auto const directory_offset = loadLittle<uint32_t>(archive.data() + end + 16);
+  if (uint64_t(directory_offset) + directory_size > end) {
+    return false;
+  }
+  m_entries.reserve(count);
+  size_t pos = directory_offset;
+  for (uint16_t i = 0; i < count; ++i) {
+    if (pos + central_header_size > end ||
+        loadLittle<uint32_t>(archive.data() + pos) != central_header_signature) {
+      return false;
+    }
+    auto const header = archive.data() + pos;
+    auto const name_size = loadLittle<uint16_t>(header + 28);
+    auto const extra_size = loadLittle<uint16_t>(header + 30);
+    auto const comment_size = loadLittle<uint16_t>(header + 32);
+    if (pos + central_header_size + name_size > end) {
+      return false;
+    }
+    m_entries.push_back({.name = {header + central_header_size, name_size},
+                         .crc = loadLittle<uint32_t>(header + 16),
+                         .compressed_size = loadLittle<uint32_t>(header + 20),
+                         .size = loadLittle<uint32_t>(header + 24),
+                         .offset = loadLittle<uint32_t>(header + 42),
+                         .method = loadLittle<uint16_t>(header + 10)});
+    pos += central_header_size + name_size + extra_size + comment_size;
+  }
+  return true;
+}
+
+bool ZipReader::contains(std::string_view name) const { return find(name) != nullptr; }
+
+ZipReader::Entry const *ZipReader::find(std::string_view name) const {
+  auto const iter = std::ranges::find(m_entries, name, &Entry::name);
+  return iter != m_entries.end() ? &*iter : nullptr;
+}
+
+std::optional<std::vector<char>> ZipReader::read(std::string_view name) const {
+  auto const entry = find(name);
+  if (!entry || entry->size > max_entry_size ||
+      uint64_t(entry->offset) + local_header_size > m_archive.size()) {
+    return {};
+  }
+  // The local header may carry a different extra field than the directory
+  auto const header = m_archive.data() + entry->offset;
+  if (loadLittle<uint32_t>(header) != local_header_signature) {
+    return {};
+  }
+  auto const data_offset = uint64_t(entry->offset) + local_header_size +
+                           loadLittle<uint16_t>(header + 26) + loadLittle<uint16_t>(header + 28);
+  if (data_offset + entry->compressed_size > m_archive.size()) {
+    return {};
+  }
+  auto const data = m_archive.subspan(data_offset, entry->compressed_size);
+  std::vector<char> output;
+  switch (entry->method) {
+  case method_store:
+    output.assign(data.begin(), data.end());
+    break;
+  case method_deflate:
+    output.reserve(entry->size);
+    if (!inflate(data, output, DeflateFormat::raw, entry->size)) {
+      return {};
+    }
+    break;
+  default:
+    return {};
+  }
+  if (output.size() != entry->size ||
+      crc32(0, reinterpret_cast<Bytef const *>(output.data()), output.size()) != entry->crc) {
+    return {};
+  }
+  return output;
+}
+
+} // namespace utility
+} // namespace imas
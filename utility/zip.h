@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace imas {
+namespace utility {
+
+// Builds a ZIP archive in memory. Entries are deflated at the fastest level
+// and get a fixed timestamp, so equal input gives equal archives.
+class ZipWriter {
+public:
+  void addFile(std::string_view name, std::span<char const> data, bool compress = true);
+  // Appends the central directory and hands out the archive
+  std::vector<char> finish();
+
+private:
+  struct Entry {
+    std::string name;
+    uint32_t crc;
+    uint32_t compressed_size;
+    uint32_t size;
+    uint32_t offset;
+    uint16_t method;
+  };
+
+  std::vector<char> m_archive;
+  std::vector<Entry> m_entries;
+};
+
+// Reads entries of a ZIP archive kept in memory, one at a time, so only the
+// parts that are needed get unpacked. ZIP64 and encryption are not supported.
+class ZipReader {
+public:
+  // The archive is referenced, not copied, and has to outlive the reader
+  bool open(std::span<char const> archive);
+  bool contains(std::string_view name) const;
+  // Unpacks an entry and checks its CRC; nothing if it is missing or broken
+  std::optional<std::vector<char>> read(std::string_view name) const;
+
+private:
+  struct Entry {
+    std::string_view name;
+    uint32_t crc;
+    uint32_t compressed_size;
+    uint32_t size;
+    uint32_t offset; // of the local header
+    uint16_t method;
+  };
+
+  Entry const *find(std::string_view name) const;
+
+  std::span<char const> m_archive;
+  std::vector<Entry> m_entries;
+};
+
+} // namespace utility
+} // namespace imas